@@ -0,0 +1,158 @@
+// Allocator microbenchmarks
+// - malloc vs plain Arena (behind a mutex, which is what sharing one takes
+//   today) vs ConcurrentArena, from 1 to 32 threads.
+// - Geometry load: filling and then re-reading a big vertex array the way
+//   create_model and the upload do, with default pages vs 2 MB pages.
+#include <chrono>
+#include <mutex>
+#include <stdio.h>
+#include <stdlib.h>
+#include <thread>
+#include <vector>
+
+#include "memory.cpp"
+
+#define ALLOCATIONS_PER_THREAD 200000
+
+enum BenchAllocator
+{
+  BenchAllocator_Malloc,
+  BenchAllocator_Arena,
+  BenchAllocator_ConcurrentArena,
+  BenchAllocator_Count
+};
+
+static const char* bench_allocator_names[BenchAllocator_Count] = {
+  "malloc",
+  "Arena+mutex",
+  "ConcurrentArena",
+};
+
+static Arena* shared_arena = 0;
+static std::mutex shared_arena_mutex;
+static ConcurrentArena* concurrent_arena = 0;
+
+static size_t bench_size(uint32_t* state)
+{
+  // xorshift, sizes between 16 and 256 bytes
+  *state ^= *state << 13;
+  *state ^= *state >> 17;
+  *state ^= *state << 5;
+  return 16 + (*state % 241);
+}
+
+static void bench_thread(BenchAllocator allocator, uint32_t seed, void** ptrs)
+{
+  uint32_t state = seed;
+  ConcurrentArenaBlock block = concurrent_arena_block(concurrent_arena);
+  for(uint32_t i = 0; i < ALLOCATIONS_PER_THREAD; i++)
+  {
+    size_t size = bench_size(&state);
+    unsigned char* memory = 0;
+    switch(allocator)
+    {
+      case BenchAllocator_Malloc:
+        memory = (unsigned char*)malloc(size);
+        break;
+      case BenchAllocator_Arena:
+      {
+        std::lock_guard<std::mutex> lock(shared_arena_mutex);
+        memory = (unsigned char*)arena_push_no_zero(shared_arena, size);
+      } break;
+      case BenchAllocator_ConcurrentArena:
+        memory = (unsigned char*)concurrent_arena_push(&block, size);
+        break;
+      case BenchAllocator_Count:
+        break;
+    }
+    memory[0] = (unsigned char)i;
+    ptrs[i] = memory;
+  }
+}
+
+#define GEOMETRY_BENCH_SIZE Megabytes(512)
+
+struct BenchVertex
+{
+  float position[3];
+  float normal[3];
+  float tex_coords[2];
+};
+
+static void bench_geometry_load(uint32_t flags)
+{
+  Arena* arena = arena_alloc_flags(Gigabytes(1), "Bench Geometry", ArenaTag_Assets, flags);
+  uint64_t count = GEOMETRY_BENCH_SIZE / sizeof(BenchVertex);
+
+  auto start = std::chrono::steady_clock::now();
+  BenchVertex* vertices = (BenchVertex*)arena_push_no_zero(arena, count * sizeof(BenchVertex));
+  for(uint64_t i = 0; i < count; i++)
+  {
+    BenchVertex* v = vertices + i;
+    v->position[0] = (float)i;
+    v->position[1] = 1.0f;
+    v->position[2] = 2.0f;
+    v->normal[0] = 0.0f;
+    v->normal[1] = 1.0f;
+    v->normal[2] = 0.0f;
+    v->tex_coords[0] = 0.5f;
+    v->tex_coords[1] = 0.5f;
+  }
+  auto filled = std::chrono::steady_clock::now();
+
+  // Strided pass, roughly what walking index buffers over it looks like
+  float sum = 0.0f;
+  for(uint64_t i = 0; i < count; i += 61)
+    sum += vertices[(i * 4099) % count].position[0];
+  auto end = std::chrono::steady_clock::now();
+
+  const char* pages = (arena->flags & ArenaFlag_HugeTLB) ? "2MB hugetlb" :
+      (arena->flags & ArenaFlag_LargePages) ? "2MB THP" : "default";
+  printf("%-16s %12.3f %12.3f %12.0f\n", pages,
+      std::chrono::duration<double, std::milli>(filled - start).count(),
+      std::chrono::duration<double, std::milli>(end - filled).count(), sum);
+}
+
+int main(int /*argc*/, char** /*argv*/)
+{
+  uint32_t thread_counts[] = {1, 2, 4, 8, 16, 32};
+  uint32_t max_threads = 32;
+  void** ptrs = (void**)malloc(sizeof(void*) * ALLOCATIONS_PER_THREAD * max_threads);
+
+  shared_arena = arena_alloc(Gigabytes(8), "Bench", ArenaTag_General);
+  concurrent_arena = concurrent_arena_alloc(Gigabytes(8), "Bench Concurrent");
+
+  printf("%-16s %8s %12s %12s\n", "allocator", "threads", "ms", "ns/alloc");
+  for(uint32_t allocator = 0; allocator < BenchAllocator_Count; allocator++)
+  {
+    for(uint32_t thread_count : thread_counts)
+    {
+      auto start = std::chrono::steady_clock::now();
+      std::vector<std::thread> threads;
+      for(uint32_t t = 0; t < thread_count; t++)
+        threads.emplace_back(bench_thread, (BenchAllocator)allocator, t + 1, ptrs + t * ALLOCATIONS_PER_THREAD);
+      for(std::thread& thread : threads)
+        thread.join();
+      auto end = std::chrono::steady_clock::now();
+
+      double ms = std::chrono::duration<double, std::milli>(end - start).count();
+      double ns_per_alloc = ms * 1e6 / ((double)ALLOCATIONS_PER_THREAD * thread_count);
+      printf("%-16s %8u %12.3f %12.2f\n", bench_allocator_names[allocator], thread_count, ms, ns_per_alloc);
+
+      // Give everything back before the next run
+      if(allocator == BenchAllocator_Malloc)
+      {
+        for(uint32_t i = 0; i < ALLOCATIONS_PER_THREAD * thread_count; i++)
+          free(ptrs[i]);
+      }
+      arena_pop_to(shared_arena, 0);
+      concurrent_arena_reset(concurrent_arena);
+    }
+  }
+  free(ptrs);
+
+  printf("\n%-16s %12s %12s %12s\n", "geometry pages", "fill ms", "gather ms", "checksum");
+  bench_geometry_load(ArenaFlag_None);
+  bench_geometry_load(ArenaFlag_LargePages);
+  return 0;
+}
@@ -1,6 +1,6 @@
 #version 330 core
-layout (location = 0) in vec3 aPos;
-layout (location = 1) in vec3 aNormal;
+layout (location = 0) in vec3 aPos; // unorm16 inside the mesh bounds
+layout (location = 1) in vec2 aNormal; // Octahedral, unorm10
 layout (location = 2) in vec2 aTexCoord;
 
 out vec2 TexCoord;
@@ -10,11 +10,24 @@ out vec3 FragPos;
 uniform mat4 model;
 uniform mat4 view;
 uniform mat4 projection;
+uniform vec3 position_offset;
+uniform vec3 position_scale;
+
+vec3 octahedral_decode(vec2 e)
+{
+	e = e * 2.0 - 1.0;
+	vec3 n = vec3(e, 1.0 - abs(e.x) - abs(e.y));
+	float t = max(-n.z, 0.0);
+	n.x += n.x >= 0.0 ? -t : t;
+	n.y += n.y >= 0.0 ? -t : t;
+	return normalize(n);
+}
 
 void main()
 {
-	gl_Position = projection * view * model * vec4(aPos, 1.0);
+	vec3 position = position_offset + aPos * position_scale;
+	gl_Position = projection * view * model * vec4(position, 1.0);
 	TexCoord = vec2(aTexCoord.x, aTexCoord.y);
-	FragPos = vec3(model * vec4(aPos, 1.0));
-	Normal = aNormal;
+	FragPos = vec3(model * vec4(position, 1.0));
+	Normal = octahedral_decode(aNormal);
 }
\ No newline at end of file
@@ -1,6 +1,5 @@
 #version 330 core
-layout (location = 0) in vec3 aPos;
-layout (location = 1) in vec3 aNormal;
+layout (location = 0) in vec3 aPos; // unorm16 inside the mesh bounds
 layout (location = 2) in vec2 aTexCoord;
 
 out vec2 TexCoord;
@@ -8,9 +7,12 @@ out vec2 TexCoord;
 uniform mat4 model;
 uniform mat4 view;
 uniform mat4 projection;
+uniform vec3 position_offset;
+uniform vec3 position_scale;
 
 void main()
 {
-	gl_Position = projection * view * model * vec4(aPos, 1.0);
+	vec3 position = position_offset + aPos * position_scale;
+	gl_Position = projection * view * model * vec4(position, 1.0);
 	TexCoord = vec2(aTexCoord.x, aTexCoord.y);
 }
\ No newline at end of file
@@ -95,6 +95,21 @@ inline idk_mat4 idk_mat4f(float value)
   return result;
 }
 
+// Column major like the rest, a * b applies b first
+inline idk_mat4 idk_mul_mat4(idk_mat4 a, idk_mat4 b)
+{
+  idk_mat4 result = {};
+  for(int column = 0; column < 4; column++)
+  {
+    for(int row = 0; row < 4; row++)
+    {
+      for(int k = 0; k < 4; k++)
+        result.elements[column][row] += a.elements[k][row] * b.elements[column][k];
+    }
+  }
+  return result;
+}
+
 inline idk_vec3 idk_cross(idk_vec3 a, idk_vec3 b)
 {
   idk_vec3 result = {};
@@ -0,0 +1,165 @@
+// #include "jobs.h"
+#include <stdint.h>
+#include <atomic>
+#include <condition_variable>
+#include <mutex>
+#include <thread>
+
+#define JOB_QUEUE_CAPACITY 1024
+#define JOB_MAX_WORKERS 64
+
+typedef void JobFunction(void* data);
+
+struct JobCounter
+{
+  std::atomic<uint32_t> pending;
+};
+
+struct Job
+{
+  JobFunction* function;
+  void* data;
+  JobCounter* counter;
+};
+
+// Ring buffer of jobs, everything in here is guarded by mutex
+struct JobQueue
+{
+  std::mutex mutex;
+  std::condition_variable has_jobs;
+  // Threads inside job_wait sleep here, signaled when a counter reaches zero
+  // and when a job gets pushed so they can help with it
+  std::condition_variable batch_done;
+  Job jobs[JOB_QUEUE_CAPACITY];
+  uint32_t head;
+  uint32_t count;
+  bool quit;
+
+  std::thread workers[JOB_MAX_WORKERS];
+  uint32_t num_workers;
+};
+
+static JobQueue job_queue;
+
+static void job_run(Job job)
+{
+  job.function(job.data);
+  if (job.counter && job.counter->pending.fetch_sub(1, std::memory_order_acq_rel) == 1)
+  {
+    // NOTE(ricardo): take the lock so a waiter can't miss the wake up between
+    // checking the counter and going to sleep
+    std::lock_guard<std::mutex> lock(job_queue.mutex);
+    job_queue.batch_done.notify_all();
+  }
+}
+
+// Expects job_queue.mutex to be held
+static Job job_pop()
+{
+  Job job = job_queue.jobs[job_queue.head];
+  job_queue.head = (job_queue.head + 1) % JOB_QUEUE_CAPACITY;
+  job_queue.count--;
+  return job;
+}
+
+static void job_worker_main()
+{
+  for (;;)
+  {
+    Job job;
+    {
+      std::unique_lock<std::mutex> lock(job_queue.mutex);
+      job_queue.has_jobs.wait(lock, [] { return job_queue.count > 0 || job_queue.quit; });
+      if (job_queue.count == 0)
+        return;
+      job = job_pop();
+    }
+    job_run(job);
+  }
+}
+
+void jobs_init(uint32_t num_workers)
+{
+  if (num_workers == 0)
+  {
+    uint32_t hardware_threads = std::thread::hardware_concurrency();
+    num_workers = hardware_threads > 1 ? hardware_threads - 1 : 1;
+  }
+  if (num_workers > JOB_MAX_WORKERS)
+    num_workers = JOB_MAX_WORKERS;
+
+  job_queue.quit = false;
+  job_queue.num_workers = num_workers;
+  for (uint32_t i = 0; i < num_workers; i++)
+    job_queue.workers[i] = std::thread(job_worker_main);
+}
+
+// Finishes whatever is still queued before the workers exit
+void jobs_shutdown()
+{
+  {
+    std::lock_guard<std::mutex> lock(job_queue.mutex);
+    job_queue.quit = true;
+  }
+  job_queue.has_jobs.notify_all();
+  for (uint32_t i = 0; i < job_queue.num_workers; i++)
+    job_queue.workers[i].join();
+  job_queue.num_workers = 0;
+}
+
+uint32_t jobs_worker_count()
+{
+  return job_queue.num_workers;
+}
+
+void job_push(JobFunction* function, void* data, JobCounter* counter)
+{
+  Job job = {function, data, counter};
+  if (counter)
+    counter->pending.fetch_add(1, std::memory_order_relaxed);
+
+  {
+    std::lock_guard<std::mutex> lock(job_queue.mutex);
+    if (job_queue.num_workers > 0 && job_queue.count < JOB_QUEUE_CAPACITY)
+    {
+      job_queue.jobs[(job_queue.head + job_queue.count) % JOB_QUEUE_CAPACITY] = job;
+      job_queue.count++;
+      job_queue.has_jobs.notify_one();
+      // NOTE(ricardo): jobs wait on jobs (mip and BC bands inside a texture
+      // decode, parse chunks inside a model load), a waiting worker has to
+      // wake up for new work too or the bands only run on idle workers
+      job_queue.batch_done.notify_one();
+      return;
+    }
+  }
+  // No workers or the queue is full, do it right here
+  job_run(job);
+}
+
+bool job_run_one()
+{
+  Job job;
+  {
+    std::lock_guard<std::mutex> lock(job_queue.mutex);
+    if (job_queue.count == 0)
+      return false;
+    job = job_pop();
+  }
+  job_run(job);
+  return true;
+}
+
+void job_wait(JobCounter* counter)
+{
+  while (counter->pending.load(std::memory_order_acquire) > 0)
+  {
+    if (job_run_one())
+      continue;
+
+    // The rest of the batch is running on workers
+    std::unique_lock<std::mutex> lock(job_queue.mutex);
+    job_queue.batch_done.wait(lock, [counter] {
+      return counter->pending.load(std::memory_order_acquire) == 0 || job_queue.count > 0;
+    });
+  }
+}
@@ -0,0 +1,29 @@
+#pragma once
+#include <stdint.h>
+#include <atomic>
+
+// Job System
+// Fixed pool of worker threads pulling from one FIFO queue guarded by a mutex.
+// A job is a function pointer plus data the caller owns. A JobCounter tracks
+// a batch of jobs, waiting on it runs queued jobs on the calling thread so the
+// waiter helps instead of sleeping. Without workers jobs run inline at push.
+#define JOB_QUEUE_CAPACITY 1024
+#define JOB_MAX_WORKERS 64
+
+typedef void JobFunction(void* data);
+
+struct JobCounter
+{
+  std::atomic<uint32_t> pending;
+};
+
+// 0 workers picks one per hardware thread, minus the main thread
+void jobs_init(uint32_t num_workers);
+void jobs_shutdown();
+uint32_t jobs_worker_count();
+
+// counter can be null for fire and forget jobs
+void job_push(JobFunction* function, void* data, JobCounter* counter);
+// Runs one queued job on the calling thread, false if the queue was empty
+bool job_run_one();
+void job_wait(JobCounter* counter);
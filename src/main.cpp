@@ -18,11 +18,23 @@ void deinit();
 
 struct Metrics
 {
-  uint32_t total_allocated = 0;
-  uint32_t total_freed = 0;
+  uint64_t total_allocated = 0;
+  uint64_t total_freed = 0;
+  // Heap traffic of the last frame
+  uint64_t frame_allocations = 0;
+  uint64_t frame_allocated = 0;
+  uint64_t frame_frees = 0;
+  uint64_t frame_freed = 0;
   uint32_t vertex_count;
   uint32_t indices_count;
-  uint32_t current_usage() const
+  // Post-transform vertex cache of the scene, before and after optimize_model
+  float acmr_before;
+  float acmr_after;
+  float atvr_before;
+  float atvr_after;
+  uint64_t geometry_bytes; // Vertex and index buffers of the scene
+  uint64_t triangles_drawn; // Last frame, both cameras, after LOD selection
+  uint64_t current_usage() const
   {
     return total_allocated - total_freed;
   }
@@ -41,41 +53,56 @@ struct Application
 static Metrics metrics;
 static Application app;
 
-// Note(ricardo): This is slow af on Windows
-#if 0
-void* operator new(size_t size)
+void framebuffer_size_callback(GLFWwindow* /*window*/, int width, int height)
 {
-  std::cout << "Allocating " << size << "bytes\n";
-  metrics.total_allocated += size;
+  glViewport(0, 0, width, height);
+}
+
+#include "memory.cpp"
+#include "jobs.cpp"
+#include "texture_compress.cpp"
+#include "idk_math.h"
+#include "camera.cpp"
+#include "opengl_renderer.cpp"
+#include "obj_parser.cpp"
+#include "mesh_optimize.cpp"
+#include "model.cpp"
+#include "sponza.cpp"
 
-  return malloc(size);
+// NOTE(ricardo): Global heap hooks, the tracker only bumps thread local
+// counters so this is cheap enough to leave on (printing every call was not)
+void* operator new(size_t size)
+{
+  void* memory = malloc(size ? size : 1);
+  if (memory == nullptr)
+    throw std::bad_alloc();
+  alloc_tracker_on_alloc(memory);
+  return memory;
 }
 
-void operator delete(void* memory, size_t size)
+void operator delete(void* memory) noexcept
 {
-  std::cout << "Freeing " << size << "bytes\n";
-  metrics.total_freed += size;
+  alloc_tracker_on_free(memory);
   free(memory);
 }
 
-void operator delete(void* memory)
+void operator delete(void* memory, size_t /*size*/) noexcept
 {
+  alloc_tracker_on_free(memory);
   free(memory);
 }
-#endif
 
-void framebuffer_size_callback(GLFWwindow* /*window*/, int width, int height)
+static void update_heap_metrics()
 {
-  glViewport(0, 0, width, height);
+  AllocStats frame = alloc_tracker_frame_end();
+  metrics.frame_allocations = frame.alloc_count;
+  metrics.frame_allocated = frame.alloc_bytes;
+  metrics.frame_frees = frame.free_count;
+  metrics.frame_freed = frame.free_bytes;
+  metrics.total_allocated += frame.alloc_bytes;
+  metrics.total_freed += frame.free_bytes;
 }
 
-#include "memory.cpp"
-#include "idk_math.h"
-#include "camera.cpp"
-#include "opengl_renderer.cpp"
-#include "model.cpp"
-#include "sponza.cpp"
-
 int main(int /*argc*/, char** /*argv*/)
 {
   if (glfwInit() == 0)
@@ -123,6 +150,8 @@ int main(int /*argc*/, char** /*argv*/)
   glStencilOp(GL_KEEP, GL_KEEP, GL_REPLACE);
   glEnable(GL_CULL_FACE);
 
+  frame_arenas_init();
+  jobs_init(0);
   init();
 
   // Main Loop
@@ -132,6 +161,7 @@ int main(int /*argc*/, char** /*argv*/)
     app.delta_time = current_frame - app.last_frame;
     app.last_frame = current_frame;
 
+    frame_begin();
     update_and_render(app.delta_time);
 
     // UI Scope
@@ -148,9 +178,11 @@ int main(int /*argc*/, char** /*argv*/)
 
     glfwPollEvents();
     glfwSwapBuffers(app.window);
+    update_heap_metrics();
   }
   // Shutdown
   deinit();
+  jobs_shutdown();
   glfwTerminate();
   ImGui_ImplOpenGL3_Shutdown();
   ImGui_ImplGlfw_Shutdown();
@@ -3,15 +3,54 @@
 #include <cstring>
 #include <stdint.h>
 #include <stddef.h>
+#include <stdarg.h>
+#include <stdio.h>
+#include <atomic>
+#include <mutex>
+#include <new>
 #ifdef _WIN32
 #include <windows.h>
+#include <malloc.h>
+#else
+#include <dlfcn.h>
+#include <execinfo.h>
+#include <sys/mman.h>
+#include <unistd.h>
+#endif
+#ifdef __APPLE__
+#include <malloc/malloc.h>
+#elif !defined(_WIN32)
+#include <malloc.h>
 #endif
 
 #define Bytes(n)      (n)
 #define Kilobytes(n)  (n << 10)
 #define Megabytes(n)  (n << 20)
-#define Gigabytes(n)  (((U64)n) << 30)
-#define Terabytes(n)  (((U64)n) << 40)
+#define Gigabytes(n)  (((uint64_t)n) << 30)
+#define Terabytes(n)  (((uint64_t)n) << 40)
+
+#define ARENA_COMMIT_GRANULARITY Kilobytes(64)
+
+enum ArenaTag
+{
+  ArenaTag_General,
+  ArenaTag_Assets,
+  ArenaTag_Renderer,
+  ArenaTag_Scratch,
+  ArenaTag_Frame,
+  ArenaTag_Count
+};
+
+// NOTE(ricardo): Large pages are a request, if the OS can't give them to us the
+// arena silently falls back to normal pages and the flag gets cleared
+enum ArenaFlags
+{
+  ArenaFlag_None = 0,
+  ArenaFlag_LargePages = 1 << 0, // 2 MB pages, MAP_HUGETLB or transparent huge pages
+  ArenaFlag_HugeTLB = 1 << 1,    // Set by arena_alloc_flags when MAP_HUGETLB worked
+};
+
+#define ARENA_LARGE_PAGE_SIZE Megabytes(2)
 
 // Linear Allocator
 // Credits to gingerBill and RyanFleury
@@ -20,25 +59,45 @@ struct Arena
   unsigned char* mem_base;
   size_t mem_length;
   size_t curr_offset;
+  size_t commit_offset;
+  // Everything past this offset is still fresh zeroed pages from the OS
+  size_t dirty_offset;
+  size_t commit_granularity;
+  uint32_t flags;
+
+  // Debug info, shown in the Metrics/Debugger window
+  const char* name;
+  ArenaTag tag;
+  size_t peak_offset;
+  uint64_t alloc_count;
+  Arena* debug_next;
 };
 
-Arena* arena_alloc(size_t capacity)
+struct ArenaDebugInfo
 {
+  const void* id; // The arena's address, only good for telling them apart
+  const char* name;
+  ArenaTag tag;
+  uint32_t flags;
+  size_t curr_offset;
+  size_t peak_offset;
+  size_t commit_offset;
+  size_t mem_length;
+  uint64_t alloc_count;
+};
 
-#ifdef _WIN32
-  Arena* arena = (Arena*)VirtualAlloc(0,capacity, MEM_COMMIT | MEM_RESERVE, PAGE_READWRITE );
-#else
-  Arena* arena = (Arena*) malloc(capacity);
-#endif
-  arena->mem_base = (unsigned char*)(arena + sizeof(arena));
-  arena->mem_length = capacity;
-  arena->curr_offset = sizeof(arena);
-  return arena;
-}
+static const char* arena_tag_names[ArenaTag_Count] = {
+  "General",
+  "Assets",
+  "Renderer",
+  "Scratch",
+  "Frame",
+};
 
-void arena_release(Arena* arena)
-{
-}
+// NOTE(ricardo): arenas can get created and released from any thread, the
+// lock covers linking/unlinking and walking the list
+static Arena* arena_debug_head = 0;
+static std::mutex arena_debug_mutex;
 
 static bool is_power_of_two(uintptr_t x)
 {
@@ -63,7 +122,216 @@ static uintptr_t align_forward(uintptr_t ptr, size_t align)
   return p;
 }
 
-void* arena_push_align(Arena* arena, size_t size, size_t align)
+// OS virtual memory layer
+static size_t os_page_size()
+{
+#ifdef _WIN32
+  SYSTEM_INFO info;
+  GetSystemInfo(&info);
+  return info.dwPageSize;
+#else
+  return (size_t)sysconf(_SC_PAGESIZE);
+#endif
+}
+
+static void* os_reserve(size_t size)
+{
+#ifdef _WIN32
+  return VirtualAlloc(0, size, MEM_RESERVE, PAGE_NOACCESS);
+#else
+  void* result = mmap(0, size, PROT_NONE, MAP_PRIVATE | MAP_ANONYMOUS | MAP_NORESERVE, -1, 0);
+  if(result == MAP_FAILED)
+    return 0;
+  return result;
+#endif
+}
+
+// Reserves address space aligned to ARENA_LARGE_PAGE_SIZE that is backed by
+// 2 MB pages, first explicit hugetlb pages and otherwise transparent huge
+// pages. Returns 0 when neither is available.
+static void* os_reserve_large(size_t size, bool* is_hugetlb)
+{
+  *is_hugetlb = false;
+#if defined(__linux__)
+  // NOTE(ricardo): hugetlb pages come out of a preallocated pool, without
+  // MAP_NORESERVE the mmap fails up front instead of SIGBUS on first touch
+  void* result = mmap(0, size, PROT_NONE, MAP_PRIVATE | MAP_ANONYMOUS | MAP_HUGETLB, -1, 0);
+  if(result != MAP_FAILED)
+  {
+    *is_hugetlb = true;
+    return result;
+  }
+
+  // Over-reserve so we can trim to a 2 MB aligned range, THP only kicks in
+  // for aligned 2 MB chunks
+  size_t padded_size = size + ARENA_LARGE_PAGE_SIZE;
+  unsigned char* padded = (unsigned char*)os_reserve(padded_size);
+  if(padded == 0)
+    return 0;
+  unsigned char* aligned = (unsigned char*)align_forward((uintptr_t)padded, ARENA_LARGE_PAGE_SIZE);
+  if(aligned != padded)
+    munmap(padded, aligned - padded);
+  size_t tail = (padded + padded_size) - (aligned + size);
+  if(tail != 0)
+    munmap(aligned + size, tail);
+
+  if(madvise(aligned, size, MADV_HUGEPAGE) != 0)
+  {
+    munmap(aligned, size);
+    return 0;
+  }
+  return aligned;
+#else
+  // TODO(ricardo): MEM_LARGE_PAGES needs SeLockMemoryPrivilege and can't be
+  // committed lazily, use normal pages on Windows for now
+  return 0;
+#endif
+}
+
+static bool os_commit(void* ptr, size_t size)
+{
+#ifdef _WIN32
+  return VirtualAlloc(ptr, size, MEM_COMMIT, PAGE_READWRITE) != 0;
+#else
+  return mprotect(ptr, size, PROT_READ | PROT_WRITE) == 0;
+#endif
+}
+
+// Gives the physical pages back but keeps the address range reserved, the
+// next commit of the range gets zero pages again
+// Returns false when the pages might still hold their old contents (madvise
+// can fail on hugetlb mappings with older kernels), they stay accessible then
+static bool os_decommit(void* ptr, size_t size)
+{
+#ifdef _WIN32
+  return VirtualFree(ptr, size, MEM_DECOMMIT) != 0;
+#else
+  if(madvise(ptr, size, MADV_DONTNEED) != 0)
+    return false;
+  // Already zero at this point, failing here only means they stay committed
+  return mprotect(ptr, size, PROT_NONE) == 0;
+#endif
+}
+
+static void os_release(void* ptr, size_t size)
+{
+#ifdef _WIN32
+  VirtualFree(ptr, 0, MEM_RELEASE);
+#else
+  munmap(ptr, size);
+#endif
+}
+
+Arena* arena_alloc_flags(size_t capacity, const char* name, ArenaTag tag, uint32_t flags)
+{
+  size_t page_size = os_page_size();
+  size_t commit_granularity = ARENA_COMMIT_GRANULARITY;
+  unsigned char* base = 0;
+  size_t reserve_size = 0;
+
+  if(flags & ArenaFlag_LargePages)
+  {
+    bool is_hugetlb = false;
+    reserve_size = align_forward(capacity, ARENA_LARGE_PAGE_SIZE);
+    base = (unsigned char*)os_reserve_large(reserve_size, &is_hugetlb);
+    if(base != 0)
+    {
+      commit_granularity = ARENA_LARGE_PAGE_SIZE;
+      if(is_hugetlb)
+        flags |= ArenaFlag_HugeTLB;
+    }
+    else
+    {
+      flags &= ~ArenaFlag_LargePages;
+    }
+  }
+
+  if(base == 0)
+  {
+    reserve_size = align_forward(capacity, page_size);
+    base = (unsigned char*)os_reserve(reserve_size);
+  }
+
+  size_t commit_size = align_forward(sizeof(Arena), commit_granularity);
+  if(commit_size > reserve_size)
+    commit_size = reserve_size;
+
+  if(base == 0 || !os_commit(base, commit_size))
+  {
+    printf("Failed to reserve arena of %zu bytes\n", reserve_size);
+    return 0;
+  }
+
+  // NOTE(ricardo): The arena header lives at the start of its own memory
+  Arena* arena = (Arena*)base;
+  arena->mem_base = base;
+  arena->mem_length = reserve_size;
+  arena->curr_offset = sizeof(Arena);
+  arena->commit_offset = commit_size;
+  arena->dirty_offset = sizeof(Arena);
+  arena->commit_granularity = commit_granularity;
+  arena->flags = flags;
+  arena->name = name;
+  arena->tag = tag;
+  arena->peak_offset = arena->curr_offset;
+  arena->alloc_count = 0;
+
+  {
+    std::lock_guard<std::mutex> lock(arena_debug_mutex);
+    arena->debug_next = arena_debug_head;
+    arena_debug_head = arena;
+  }
+  return arena;
+}
+
+Arena* arena_alloc(size_t capacity, const char* name, ArenaTag tag)
+{
+  return arena_alloc_flags(capacity, name, tag, ArenaFlag_None);
+}
+
+// NOTE(ricardo): taken under the lock so a worker can't release (and unmap)
+// an arena while we follow debug_next. Offsets of arenas owned by other
+// threads are whatever they were at that moment.
+uint32_t arena_debug_snapshot(ArenaDebugInfo* out, uint32_t max_count)
+{
+  std::lock_guard<std::mutex> lock(arena_debug_mutex);
+  uint32_t count = 0;
+  for(Arena* it = arena_debug_head; it != 0 && count < max_count; it = it->debug_next)
+  {
+    ArenaDebugInfo* info = out + count++;
+    info->id = it;
+    info->name = it->name;
+    info->tag = it->tag;
+    info->flags = it->flags;
+    info->curr_offset = it->curr_offset;
+    info->peak_offset = it->peak_offset;
+    info->commit_offset = it->commit_offset;
+    info->mem_length = it->mem_length;
+    info->alloc_count = it->alloc_count;
+  }
+  return count;
+}
+
+const char* arena_tag_name(ArenaTag tag)
+{
+  return arena_tag_names[tag];
+}
+
+void arena_release(Arena* arena)
+{
+  {
+    std::lock_guard<std::mutex> lock(arena_debug_mutex);
+    Arena** it = &arena_debug_head;
+    while(*it != 0 && *it != arena)
+      it = &(*it)->debug_next;
+    if(*it == arena)
+      *it = arena->debug_next;
+  }
+  // NOTE(ricardo): The header lives inside the mapping, don't touch arena after this
+  os_release(arena->mem_base, arena->mem_length);
+}
+
+void* arena_push_align_no_zero(Arena* arena, size_t size, size_t align)
 {
   uintptr_t curr_ptr = (uintptr_t)arena->mem_base + (uintptr_t)arena->curr_offset;
   uintptr_t offset = align_forward(curr_ptr, align);
@@ -71,16 +339,83 @@ void* arena_push_align(Arena* arena, size_t size, size_t align)
 
   if( offset + size <= arena->mem_length)
   {
+    // Commit more pages if we grew past the committed region
+    if(offset + size > arena->commit_offset)
+    {
+      size_t new_commit_offset = align_forward(offset + size, arena->commit_granularity);
+      if(new_commit_offset > arena->mem_length)
+        new_commit_offset = arena->mem_length;
+      if(!os_commit(arena->mem_base + arena->commit_offset, new_commit_offset - arena->commit_offset))
+        return NULL;
+      arena->commit_offset = new_commit_offset;
+    }
+
     void* memory = &arena->mem_base[offset];
     arena->curr_offset = offset + size;
-    // Zero new memory by default
-    memset(memory, 0, size);
+    if(arena->curr_offset > arena->peak_offset)
+      arena->peak_offset = arena->curr_offset;
+    if(arena->curr_offset > arena->dirty_offset)
+      arena->dirty_offset = arena->curr_offset;
+    arena->alloc_count++;
 
     return memory;
   }
   return NULL;
 }
 
+void* arena_push_align(Arena* arena, size_t size, size_t align)
+{
+  size_t dirty_offset = arena->dirty_offset;
+  unsigned char* memory = (unsigned char*)arena_push_align_no_zero(arena, size, align);
+  if(memory == NULL)
+    return NULL;
+
+  // Zero new memory by default, but only the bytes that were handed out
+  // before. Anything past the old dirty offset comes straight from the OS
+  // as zero pages and touching it would just fault them in for nothing.
+  size_t offset = memory - arena->mem_base;
+  if(offset < dirty_offset)
+  {
+    size_t dirty_size = dirty_offset - offset;
+    memset(memory, 0, dirty_size < size ? dirty_size : size);
+  }
+  return memory;
+}
+
+void arena_pop_to(Arena* arena, size_t pos)
+{
+  // NOTE(ricardo): Never pop the arena header
+  if(pos < sizeof(Arena))
+    pos = sizeof(Arena);
+  assert(pos <= arena->curr_offset);
+  arena->curr_offset = pos;
+}
+
+// Pops everything but keeps the pages committed so they are reused hot
+void arena_reset(Arena* arena)
+{
+  arena_pop_to(arena, 0);
+}
+
+// Decommits every page past max(offset, curr_offset), resident memory drops
+// back to what is in use. Committing them again is handled by the next push.
+void arena_decommit(Arena* arena, size_t offset)
+{
+  if(offset < arena->curr_offset)
+    offset = arena->curr_offset;
+  size_t decommit_offset = align_forward(offset, arena->commit_granularity);
+  if(decommit_offset >= arena->commit_offset)
+    return;
+
+  // NOTE(ricardo): arena_push skips the memset past dirty_offset, only move
+  // it once the pages really went back
+  if(!os_decommit(arena->mem_base + decommit_offset, arena->commit_offset - decommit_offset))
+    return;
+  arena->commit_offset = decommit_offset;
+  if(arena->dirty_offset > decommit_offset)
+    arena->dirty_offset = decommit_offset;
+}
+
 #ifndef DEFAULT_ALIGNMENT
 #define DEFAULT_ALIGNMENT (2*sizeof(void*))
 #endif
@@ -89,3 +424,859 @@ void* arena_push(Arena* arena, size_t size)
 {
   return arena_push_align(arena, size, DEFAULT_ALIGNMENT);
 }
+
+void* arena_push_no_zero(Arena* arena, size_t size)
+{
+  return arena_push_align_no_zero(arena, size, DEFAULT_ALIGNMENT);
+}
+
+// Temporary Memory
+struct TempArena
+{
+  Arena* arena;
+  size_t pos;
+};
+
+TempArena temp_arena_begin(Arena* arena)
+{
+  TempArena temp = {};
+  temp.arena = arena;
+  temp.pos = arena->curr_offset;
+  return temp;
+}
+
+void temp_arena_end(TempArena temp)
+{
+  arena_pop_to(temp.arena, temp.pos);
+}
+
+// Scratch Arenas
+#define SCRATCH_ARENA_COUNT 2
+#define SCRATCH_ARENA_RESERVE Gigabytes(1)
+
+static thread_local Arena* scratch_arenas[SCRATCH_ARENA_COUNT] = {};
+
+TempArena scratch_begin(Arena** conflicts, uint32_t conflict_count)
+{
+  for(uint32_t i = 0; i < SCRATCH_ARENA_COUNT; i++)
+  {
+    if(scratch_arenas[i] == 0)
+      scratch_arenas[i] = arena_alloc(SCRATCH_ARENA_RESERVE, "Scratch", ArenaTag_Scratch);
+
+    bool is_conflicting = false;
+    for(uint32_t j = 0; j < conflict_count; j++)
+    {
+      if(scratch_arenas[i] == conflicts[j])
+      {
+        is_conflicting = true;
+        break;
+      }
+    }
+    if(!is_conflicting)
+      return temp_arena_begin(scratch_arenas[i]);
+  }
+  assert(!"Ran out of scratch arenas, increase SCRATCH_ARENA_COUNT");
+  return {};
+}
+
+void scratch_end(TempArena scratch)
+{
+  temp_arena_end(scratch);
+}
+
+// Frame Arenas
+#define FRAMES_IN_FLIGHT 2
+#define FRAME_ARENA_RESERVE Gigabytes(1)
+
+struct FrameArenas
+{
+  Arena* arenas[FRAMES_IN_FLIGHT];
+  uint64_t frame_index;
+};
+
+static FrameArenas frame_arenas = {};
+
+void frame_arenas_init()
+{
+  for(uint32_t i = 0; i < FRAMES_IN_FLIGHT; i++)
+  {
+    if(frame_arenas.arenas[i] == 0)
+      frame_arenas.arenas[i] = arena_alloc(FRAME_ARENA_RESERVE, "Frame", ArenaTag_Frame);
+  }
+  frame_arenas.frame_index = 0;
+}
+
+Arena* frame_arena()
+{
+  return frame_arenas.arenas[frame_arenas.frame_index % FRAMES_IN_FLIGHT];
+}
+
+Arena* previous_frame_arena()
+{
+  return frame_arenas.arenas[(frame_arenas.frame_index + FRAMES_IN_FLIGHT - 1) % FRAMES_IN_FLIGHT];
+}
+
+void frame_begin()
+{
+  frame_arenas.frame_index++;
+  Arena* arena = frame_arena();
+  // NOTE(ricardo): committed pages stay around, resetting is just moving the offset
+  arena_reset(arena);
+}
+
+// Pool Allocator
+struct PoolFreeNode
+{
+  PoolFreeNode* next;
+};
+
+struct Pool
+{
+  Arena* arena;
+  size_t element_size;
+  PoolFreeNode* free_list;
+  uint32_t count;
+};
+
+#define POOL_PUSH(pool, type) (type*)pool_push(pool)
+
+Pool* pool_alloc(size_t element_size, size_t capacity, const char* name, ArenaTag tag)
+{
+  Arena* arena = arena_alloc(capacity, name, tag);
+  Pool* pool = (Pool*)arena_push(arena, sizeof(Pool));
+  pool->arena = arena;
+  // NOTE(ricardo): Free elements store the free list link inside themselves
+  if(element_size < sizeof(PoolFreeNode))
+    element_size = sizeof(PoolFreeNode);
+  pool->element_size = align_forward(element_size, DEFAULT_ALIGNMENT);
+  pool->free_list = 0;
+  pool->count = 0;
+  return pool;
+}
+
+void* pool_push(Pool* pool)
+{
+  void* element = pool->free_list;
+  if(element != 0)
+  {
+    pool->free_list = pool->free_list->next;
+    memset(element, 0, pool->element_size);
+  }
+  else
+  {
+    element = arena_push(pool->arena, pool->element_size);
+    if(element == 0)
+      return 0;
+  }
+  pool->count++;
+  return element;
+}
+
+void pool_release(Pool* pool)
+{
+  // The pool header lives in its own arena
+  arena_release(pool->arena);
+}
+
+void pool_free(Pool* pool, void* element)
+{
+  if(element == 0)
+    return;
+  PoolFreeNode* node = (PoolFreeNode*)element;
+  node->next = pool->free_list;
+  pool->free_list = node;
+  pool->count--;
+}
+
+// Concurrent Arena
+// Threads reserve sub-blocks with an atomic fetch-add and then bump allocate
+// inside their own block without touching shared state. Each thread keeps a
+// ConcurrentArenaBlock cursor, the plain Arena stays the single threaded path.
+#define CONCURRENT_ARENA_BLOCK_SIZE Kilobytes(64)
+
+struct ConcurrentArena
+{
+  unsigned char* mem_base;
+  size_t mem_length;
+  std::atomic<size_t> curr_offset;
+  // Only written by concurrent_arena_reset while nobody is pushing
+  size_t dirty_offset;
+  size_t page_size;
+  const char* name;
+};
+
+struct ConcurrentArenaBlock
+{
+  ConcurrentArena* arena;
+  size_t offset;
+  size_t end;
+};
+
+ConcurrentArena* concurrent_arena_alloc(size_t capacity, const char* name)
+{
+  size_t page_size = os_page_size();
+  size_t reserve_size = align_forward(capacity, page_size);
+  size_t header_size = align_forward(sizeof(ConcurrentArena), page_size);
+
+  unsigned char* base = (unsigned char*)os_reserve(reserve_size);
+  if(base == 0 || !os_commit(base, header_size))
+  {
+    printf("Failed to reserve concurrent arena of %zu bytes\n", reserve_size);
+    return 0;
+  }
+
+  ConcurrentArena* arena = new (base) ConcurrentArena();
+  arena->mem_base = base;
+  arena->mem_length = reserve_size;
+  arena->curr_offset.store(header_size, std::memory_order_relaxed);
+  arena->dirty_offset = header_size;
+  arena->page_size = page_size;
+  arena->name = name;
+  return arena;
+}
+
+// Grabs a page aligned range of the shared reservation and commits it
+static size_t concurrent_arena_reserve_range(ConcurrentArena* arena, size_t size)
+{
+  size = align_forward(size, arena->page_size);
+  size_t start = arena->curr_offset.fetch_add(size, std::memory_order_relaxed);
+  if(start + size > arena->mem_length)
+    return 0;
+  // NOTE(ricardo): ranges never share pages so threads can commit independently
+  if(!os_commit(arena->mem_base + start, size))
+    return 0;
+  return start;
+}
+
+ConcurrentArenaBlock concurrent_arena_block(ConcurrentArena* arena)
+{
+  ConcurrentArenaBlock block = {};
+  block.arena = arena;
+  return block;
+}
+
+void* concurrent_arena_push_align(ConcurrentArenaBlock* block, size_t size, size_t align)
+{
+  ConcurrentArena* arena = block->arena;
+  size_t offset = align_forward(block->offset, align);
+  if(block->end == 0 || offset + size > block->end)
+  {
+    // Big allocations get their own range so they don't waste the thread's block
+    if(size + align > CONCURRENT_ARENA_BLOCK_SIZE / 4)
+    {
+      size_t start = concurrent_arena_reserve_range(arena, size + align);
+      if(start == 0)
+        return NULL;
+      offset = align_forward(start, align);
+      void* memory = arena->mem_base + offset;
+      if(offset < arena->dirty_offset)
+        memset(memory, 0, size);
+      return memory;
+    }
+
+    size_t start = concurrent_arena_reserve_range(arena, CONCURRENT_ARENA_BLOCK_SIZE);
+    if(start == 0)
+      return NULL;
+    block->offset = start;
+    block->end = start + CONCURRENT_ARENA_BLOCK_SIZE;
+    offset = align_forward(block->offset, align);
+  }
+
+  block->offset = offset + size;
+  void* memory = arena->mem_base + offset;
+  // Same as the plain arena, fresh pages are already zero
+  if(offset < arena->dirty_offset)
+    memset(memory, 0, size);
+  return memory;
+}
+
+void* concurrent_arena_push(ConcurrentArenaBlock* block, size_t size)
+{
+  return concurrent_arena_push_align(block, size, DEFAULT_ALIGNMENT);
+}
+
+void concurrent_arena_release(ConcurrentArena* arena)
+{
+  os_release(arena->mem_base, arena->mem_length);
+}
+
+// NOTE(ricardo): No thread can be pushing, every ConcurrentArenaBlock handed
+// out before is invalid after this
+void concurrent_arena_reset(ConcurrentArena* arena)
+{
+  size_t curr_offset = arena->curr_offset.load(std::memory_order_relaxed);
+  if(curr_offset > arena->mem_length)
+    curr_offset = arena->mem_length;
+  if(curr_offset > arena->dirty_offset)
+    arena->dirty_offset = curr_offset;
+  arena->curr_offset.store(align_forward(sizeof(ConcurrentArena), arena->page_size), std::memory_order_relaxed);
+}
+
+// Growable Array
+// Grows in place when it is the last allocation of its arena, otherwise it
+// moves to a new block at the end of the arena (old block is left behind).
+template<typename T>
+struct Array
+{
+  Arena* arena;
+  T* data;
+  uint64_t count;
+  uint64_t capacity;
+
+  T& operator[](uint64_t index)
+  {
+    assert(index < count);
+    return data[index];
+  }
+};
+
+// Returns true if the block at ptr could be extended without moving
+static bool arena_grow_in_place(Arena* arena, void* ptr, size_t old_size, size_t new_size)
+{
+  if((unsigned char*)ptr + old_size != arena->mem_base + arena->curr_offset)
+    return false;
+  return arena_push_align_no_zero(arena, new_size - old_size, 1) != NULL;
+}
+
+template<typename T>
+Array<T> array_init(Arena* arena, uint64_t capacity)
+{
+  Array<T> array = {};
+  array.arena = arena;
+  array.data = (T*)arena_push_align_no_zero(arena, capacity * sizeof(T), alignof(T));
+  array.capacity = array.data ? capacity : 0;
+  return array;
+}
+
+template<typename T>
+void array_reserve(Array<T>* array, uint64_t capacity)
+{
+  if(capacity <= array->capacity)
+    return;
+
+  if(array->data && arena_grow_in_place(array->arena, array->data, array->capacity * sizeof(T), capacity * sizeof(T)))
+  {
+    array->capacity = capacity;
+    return;
+  }
+
+  T* data = (T*)arena_push_align_no_zero(array->arena, capacity * sizeof(T), alignof(T));
+  assert(data != NULL);
+  if(array->count)
+    memcpy(data, array->data, array->count * sizeof(T));
+  array->data = data;
+  array->capacity = capacity;
+}
+
+template<typename T>
+T* array_push(Array<T>* array, const T& value)
+{
+  if(array->count == array->capacity)
+    array_reserve(array, array->capacity ? array->capacity * 2 : 16);
+  T* result = array->data + array->count++;
+  *result = value;
+  return result;
+}
+
+// Strings
+// Not owning view into some memory, not necessarily null terminated unless
+// it came from one of the str_push functions
+struct StringView
+{
+  const char* data;
+  uint64_t size;
+};
+
+StringView str_view(const char* cstr)
+{
+  StringView result = {};
+  result.data = cstr;
+  result.size = cstr ? strlen(cstr) : 0;
+  return result;
+}
+
+StringView str_view(const char* data, uint64_t size)
+{
+  StringView result = {};
+  result.data = data;
+  result.size = size;
+  return result;
+}
+
+bool str_equal(StringView a, StringView b)
+{
+  return a.size == b.size && (a.size == 0 || memcmp(a.data, b.data, a.size) == 0);
+}
+
+StringView str_push_copy(Arena* arena, StringView str)
+{
+  char* data = (char*)arena_push_no_zero(arena, str.size + 1);
+  memcpy(data, str.data, str.size);
+  data[str.size] = '\0';
+  return str_view(data, str.size);
+}
+
+StringView str_push_concat(Arena* arena, StringView a, StringView b)
+{
+  char* data = (char*)arena_push_no_zero(arena, a.size + b.size + 1);
+  memcpy(data, a.data, a.size);
+  memcpy(data + a.size, b.data, b.size);
+  data[a.size + b.size] = '\0';
+  return str_view(data, a.size + b.size);
+}
+
+StringView str_push_fmt(Arena* arena, const char* fmt, ...)
+{
+  va_list args;
+  va_start(args, fmt);
+  va_list args_copy;
+  va_copy(args_copy, args);
+  int size = vsnprintf(0, 0, fmt, args);
+  char* data = (char*)arena_push_no_zero(arena, size + 1);
+  vsnprintf(data, size + 1, fmt, args_copy);
+  va_end(args_copy);
+  va_end(args);
+  return str_view(data, size);
+}
+
+// Everything before the last '/', or an empty view if there is none
+StringView str_chop_last_slash(StringView str)
+{
+  for(uint64_t i = str.size; i > 0; i--)
+  {
+    if(str.data[i - 1] == '/')
+      return str_view(str.data, i - 1);
+  }
+  return str_view(str.data, 0);
+}
+
+// '\\' becomes '/', empty and "." segments are dropped and "name/.." pairs
+// cancel out. A leading '/' and leading ".." segments are kept.
+StringView str_push_normalized_path(Arena* arena, StringView path)
+{
+  char* data = (char*)arena_push_no_zero(arena, path.size + 1);
+  uint64_t size = 0;
+  uint64_t root = 0; // ".." never pops below this
+  if(path.size && (path.data[0] == '/' || path.data[0] == '\\'))
+  {
+    data[size++] = '/';
+    root = 1;
+  }
+
+  uint64_t i = 0;
+  while(i < path.size)
+  {
+    uint64_t start = i;
+    while(i < path.size && path.data[i] != '/' && path.data[i] != '\\')
+      i++;
+    StringView segment = str_view(path.data + start, i - start);
+    i++;
+
+    if(segment.size == 0 || str_equal(segment, str_view(".")))
+      continue;
+    if(str_equal(segment, str_view("..")))
+    {
+      uint64_t last = size;
+      while(last > root && data[last - 1] != '/')
+        last--;
+      StringView previous = str_view(data + last, size - last);
+      if(previous.size && !str_equal(previous, segment))
+      {
+        size = last > root ? last - 1 : root;
+        continue;
+      }
+      if(root)
+        continue; // "/.." is still "/"
+    }
+
+    if(size > root)
+      data[size++] = '/';
+    memcpy(data + size, segment.data, segment.size);
+    size += segment.size;
+  }
+  data[size] = '\0';
+  return str_view(data, size);
+}
+
+// Builds a string by appending to an arena-backed char array
+struct StringBuilder
+{
+  Array<char> chars;
+};
+
+StringBuilder str_builder_init(Arena* arena, uint64_t capacity)
+{
+  StringBuilder builder = {};
+  builder.chars = array_init<char>(arena, capacity);
+  return builder;
+}
+
+void str_builder_append(StringBuilder* builder, StringView str)
+{
+  array_reserve(&builder->chars, builder->chars.count + str.size + 1);
+  memcpy(builder->chars.data + builder->chars.count, str.data, str.size);
+  builder->chars.count += str.size;
+}
+
+// NOTE(ricardo): The view is null terminated and stays valid as long as nothing
+// else gets appended
+StringView str_builder_view(StringBuilder* builder)
+{
+  array_reserve(&builder->chars, builder->chars.count + 1);
+  builder->chars.data[builder->chars.count] = '\0';
+  return str_view(builder->chars.data, builder->chars.count);
+}
+
+// Hashing
+uint64_t hash_bytes(const void* data, uint64_t size)
+{
+  // 8 bytes at a time, FNV-1a for the tail and a splitmix64 finalizer so the
+  // low bits (the ones the hash map uses) depend on every input byte
+  const unsigned char* bytes = (const unsigned char*)data;
+  uint64_t hash = 14695981039346656037ull ^ size;
+  uint64_t i = 0;
+  for(; i + 8 <= size; i += 8)
+  {
+    uint64_t word;
+    memcpy(&word, bytes + i, 8);
+    hash = (hash ^ word) * 0x9E3779B97F4A7C15ull;
+    hash ^= hash >> 32;
+  }
+  for(; i < size; i++)
+  {
+    hash ^= bytes[i];
+    hash *= 1099511628211ull;
+  }
+  hash ^= hash >> 30;
+  hash *= 0xBF58476D1CE4E5B9ull;
+  hash ^= hash >> 27;
+  hash *= 0x94D049BB133111EBull;
+  hash ^= hash >> 31;
+  return hash;
+}
+
+template<typename K>
+uint64_t hash_key(const K& key)
+{
+  return hash_bytes(&key, sizeof(K));
+}
+
+uint64_t hash_key(const StringView& key)
+{
+  return hash_bytes(key.data, key.size);
+}
+
+template<typename K>
+bool key_equal(const K& a, const K& b)
+{
+  return a == b;
+}
+
+bool key_equal(const StringView& a, const StringView& b)
+{
+  return str_equal(a, b);
+}
+
+// Hash Map
+// Open addressing with linear probing, capacity is always a power of two.
+// Entries can't be removed, the map goes away with its arena.
+template<typename K, typename V>
+struct HashMap
+{
+  Arena* arena;
+  K* keys;
+  V* values;
+  uint8_t* occupied;
+  uint64_t count;
+  uint64_t capacity;
+};
+
+template<typename K, typename V>
+HashMap<K, V> hash_map_init(Arena* arena, uint64_t capacity)
+{
+  HashMap<K, V> map = {};
+  map.arena = arena;
+  map.capacity = 16;
+  while(map.capacity < capacity)
+    map.capacity *= 2;
+  map.keys = (K*)arena_push_align_no_zero(arena, map.capacity * sizeof(K), alignof(K));
+  map.values = (V*)arena_push_align_no_zero(arena, map.capacity * sizeof(V), alignof(V));
+  map.occupied = (uint8_t*)arena_push(arena, map.capacity);
+  return map;
+}
+
+template<typename K, typename V>
+static uint64_t hash_map_find_slot(HashMap<K, V>* map, const K& key)
+{
+  uint64_t mask = map->capacity - 1;
+  uint64_t slot = hash_key(key) & mask;
+  while(map->occupied[slot] && !key_equal(map->keys[slot], key))
+    slot = (slot + 1) & mask;
+  return slot;
+}
+
+template<typename K, typename V>
+V* hash_map_get(HashMap<K, V>* map, const K& key)
+{
+  uint64_t slot = hash_map_find_slot(map, key);
+  return map->occupied[slot] ? &map->values[slot] : 0;
+}
+
+template<typename K, typename V>
+V* hash_map_put(HashMap<K, V>* map, const K& key, const V& value)
+{
+  // Keep the load factor under 3/4
+  if((map->count + 1) * 4 > map->capacity * 3)
+  {
+    HashMap<K, V> grown = hash_map_init<K, V>(map->arena, map->capacity * 2);
+    for(uint64_t i = 0; i < map->capacity; i++)
+    {
+      if(map->occupied[i])
+        hash_map_put(&grown, map->keys[i], map->values[i]);
+    }
+    *map = grown;
+  }
+
+  uint64_t slot = hash_map_find_slot(map, key);
+  if(!map->occupied[slot])
+  {
+    map->occupied[slot] = 1;
+    map->keys[slot] = key;
+    map->count++;
+  }
+  map->values[slot] = value;
+  return &map->values[slot];
+}
+
+// Heap Allocation Tracker
+// Fed by the global operator new/delete hooks. Each thread bumps its own
+// counters (single writer, so no locked instructions) and once per frame
+// the main thread sums them up. One in ALLOC_SAMPLE_RATE allocations also
+// records its call stack into a small ring buffer.
+#define ALLOC_SAMPLE_RATE 1024
+#define ALLOC_SAMPLE_MAX_FRAMES 16
+#define ALLOC_SAMPLE_COUNT 64
+
+struct AllocStats
+{
+  uint64_t alloc_count;
+  uint64_t alloc_bytes;
+  uint64_t free_count;
+  uint64_t free_bytes;
+};
+
+struct AllocSample
+{
+  size_t size;
+  uint64_t frame_index;
+  uint32_t frame_count;
+  void* frames[ALLOC_SAMPLE_MAX_FRAMES];
+};
+
+struct AllocThreadCounters
+{
+  std::atomic<uint64_t> alloc_count;
+  std::atomic<uint64_t> alloc_bytes;
+  std::atomic<uint64_t> free_count;
+  std::atomic<uint64_t> free_bytes;
+  uint32_t sample_countdown;
+  bool sampling;
+  AllocThreadCounters* next;
+};
+
+// NOTE(ricardo): any allocating thread writes these while the UI reads them.
+// sequence is odd while a writer is inside the slot, readers copy the fields
+// and throw the copy away if sequence changed or was odd (a seqlock).
+struct AllocSampleSlot
+{
+  std::atomic<uint64_t> sequence;
+  std::atomic<size_t> size;
+  std::atomic<uint64_t> frame_index;
+  std::atomic<uint32_t> frame_count;
+  std::atomic<void*> frames[ALLOC_SAMPLE_MAX_FRAMES];
+};
+
+struct AllocTracker
+{
+  std::atomic<AllocThreadCounters*> threads;
+  std::atomic<uint64_t> sample_write_index;
+  AllocSampleSlot samples[ALLOC_SAMPLE_COUNT];
+  AllocStats last_totals;
+  std::atomic<uint64_t> frame_index; // Only the main thread bumps it
+};
+
+static AllocTracker alloc_tracker = {};
+static thread_local AllocThreadCounters* alloc_thread_counters = 0;
+
+static size_t alloc_usable_size(void* ptr)
+{
+#if defined(_WIN32)
+  return _msize(ptr);
+#elif defined(__APPLE__)
+  return malloc_size(ptr);
+#else
+  return malloc_usable_size(ptr);
+#endif
+}
+
+static AllocThreadCounters* alloc_get_thread_counters()
+{
+  AllocThreadCounters* counters = alloc_thread_counters;
+  if(counters == 0)
+  {
+    // NOTE(ricardo): calloc, not new, we are called from inside operator new.
+    // Counters of threads that exit stay in the list so totals don't go back.
+    counters = (AllocThreadCounters*)calloc(1, sizeof(AllocThreadCounters));
+    counters->sample_countdown = ALLOC_SAMPLE_RATE;
+    counters->next = alloc_tracker.threads.load(std::memory_order_relaxed);
+    while(!alloc_tracker.threads.compare_exchange_weak(counters->next, counters, std::memory_order_release,
+          std::memory_order_relaxed))
+    {
+    }
+    alloc_thread_counters = counters;
+  }
+  return counters;
+}
+
+// Only the owning thread writes, readers just need to see a whole value
+static void alloc_counter_add(std::atomic<uint64_t>* counter, uint64_t value)
+{
+  counter->store(counter->load(std::memory_order_relaxed) + value, std::memory_order_relaxed);
+}
+
+static void alloc_tracker_sample(AllocThreadCounters* counters, size_t size)
+{
+  // backtrace can allocate the first time it runs, don't sample ourselves
+  if(counters->sampling)
+    return;
+  counters->sampling = true;
+
+  // Walk the stack before taking the slot so it stays odd for as short as possible
+  void* frames[ALLOC_SAMPLE_MAX_FRAMES];
+#ifdef _WIN32
+  uint32_t frame_count = CaptureStackBackTrace(2, ALLOC_SAMPLE_MAX_FRAMES, frames, 0);
+#else
+  uint32_t frame_count = (uint32_t)backtrace(frames, ALLOC_SAMPLE_MAX_FRAMES);
+#endif
+
+  uint64_t index = alloc_tracker.sample_write_index.fetch_add(1, std::memory_order_relaxed);
+  AllocSampleSlot* slot = &alloc_tracker.samples[index % ALLOC_SAMPLE_COUNT];
+  // Once the ring wraps another thread can still be writing this slot, that
+  // one wins and this sample is dropped
+  uint64_t sequence = slot->sequence.load(std::memory_order_relaxed);
+  if((sequence & 1) == 0 &&
+      slot->sequence.compare_exchange_strong(sequence, sequence + 1, std::memory_order_relaxed))
+  {
+    std::atomic_thread_fence(std::memory_order_release);
+    slot->size.store(size, std::memory_order_relaxed);
+    slot->frame_index.store(alloc_tracker.frame_index.load(std::memory_order_relaxed), std::memory_order_relaxed);
+    slot->frame_count.store(frame_count, std::memory_order_relaxed);
+    for(uint32_t i = 0; i < frame_count; i++)
+      slot->frames[i].store(frames[i], std::memory_order_relaxed);
+    slot->sequence.store(sequence + 2, std::memory_order_release);
+  }
+
+  counters->sampling = false;
+}
+
+void alloc_tracker_on_alloc(void* ptr)
+{
+  if(ptr == 0)
+    return;
+  AllocThreadCounters* counters = alloc_get_thread_counters();
+  size_t size = alloc_usable_size(ptr);
+  alloc_counter_add(&counters->alloc_count, 1);
+  alloc_counter_add(&counters->alloc_bytes, size);
+
+  if(--counters->sample_countdown == 0)
+  {
+    counters->sample_countdown = ALLOC_SAMPLE_RATE;
+    alloc_tracker_sample(counters, size);
+  }
+}
+
+void alloc_tracker_on_free(void* ptr)
+{
+  if(ptr == 0)
+    return;
+  AllocThreadCounters* counters = alloc_get_thread_counters();
+  alloc_counter_add(&counters->free_count, 1);
+  alloc_counter_add(&counters->free_bytes, alloc_usable_size(ptr));
+}
+
+AllocStats alloc_tracker_totals()
+{
+  AllocStats totals = {};
+  for(AllocThreadCounters* it = alloc_tracker.threads.load(std::memory_order_acquire); it != 0; it = it->next)
+  {
+    totals.alloc_count += it->alloc_count.load(std::memory_order_relaxed);
+    totals.alloc_bytes += it->alloc_bytes.load(std::memory_order_relaxed);
+    totals.free_count += it->free_count.load(std::memory_order_relaxed);
+    totals.free_bytes += it->free_bytes.load(std::memory_order_relaxed);
+  }
+  return totals;
+}
+
+// Returns what happened on the heap since the last call
+AllocStats alloc_tracker_frame_end()
+{
+  AllocStats totals = alloc_tracker_totals();
+  AllocStats frame = {};
+  frame.alloc_count = totals.alloc_count - alloc_tracker.last_totals.alloc_count;
+  frame.alloc_bytes = totals.alloc_bytes - alloc_tracker.last_totals.alloc_bytes;
+  frame.free_count = totals.free_count - alloc_tracker.last_totals.free_count;
+  frame.free_bytes = totals.free_bytes - alloc_tracker.last_totals.free_bytes;
+  alloc_tracker.last_totals = totals;
+  alloc_tracker.frame_index.fetch_add(1, std::memory_order_relaxed);
+  return frame;
+}
+
+uint64_t alloc_tracker_frame_index()
+{
+  return alloc_tracker.frame_index.load(std::memory_order_relaxed);
+}
+
+// Copies out the most recent samples, newest first. Slots that are being
+// written (or got rewritten during the copy) are skipped.
+uint32_t alloc_tracker_samples(AllocSample* out, uint32_t max_count)
+{
+  uint64_t write_index = alloc_tracker.sample_write_index.load(std::memory_order_relaxed);
+  uint64_t available = write_index < ALLOC_SAMPLE_COUNT ? write_index : ALLOC_SAMPLE_COUNT;
+  uint32_t count = 0;
+  for(uint64_t i = 0; i < available && count < max_count; i++)
+  {
+    AllocSampleSlot* slot = &alloc_tracker.samples[(write_index - 1 - i) % ALLOC_SAMPLE_COUNT];
+    uint64_t sequence = slot->sequence.load(std::memory_order_acquire);
+    if(sequence & 1)
+      continue;
+    AllocSample* sample = out + count;
+    sample->size = slot->size.load(std::memory_order_relaxed);
+    sample->frame_index = slot->frame_index.load(std::memory_order_relaxed);
+    sample->frame_count = slot->frame_count.load(std::memory_order_relaxed);
+    if(sample->frame_count > ALLOC_SAMPLE_MAX_FRAMES)
+      sample->frame_count = ALLOC_SAMPLE_MAX_FRAMES;
+    for(uint32_t frame = 0; frame < sample->frame_count; frame++)
+      sample->frames[frame] = slot->frames[frame].load(std::memory_order_relaxed);
+    std::atomic_thread_fence(std::memory_order_acquire);
+    if(sequence == 0 || slot->sequence.load(std::memory_order_relaxed) != sequence)
+      continue;
+    count++;
+  }
+  return count;
+}
+
+// Best effort name for a return address, doesn't allocate
+void alloc_sample_symbol(void* address, char* buffer, size_t size)
+{
+#ifdef _WIN32
+  snprintf(buffer, size, "%p", address);
+#else
+  Dl_info info = {};
+  if(dladdr(address, &info) != 0 && info.dli_sname != 0)
+    snprintf(buffer, size, "%s+0x%zx", info.dli_sname, (size_t)((char*)address - (char*)info.dli_saddr));
+  else if(info.dli_fname != 0)
+    snprintf(buffer, size, "%s(%p)", info.dli_fname, address);
+  else
+    snprintf(buffer, size, "%p", address);
+#endif
+}
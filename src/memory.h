@@ -2,27 +2,285 @@
 
 #include <stdint.h>
 #include <stddef.h>
+#include <atomic>
 
 #define Bytes(n)      (n)
 #define Kilobytes(n)  (n << 10)
 #define Megabytes(n)  (n << 20)
-#define Gigabytes(n)  (((U64)n) << 30)
-#define Terabytes(n)  (((U64)n) << 40)
+#define Gigabytes(n)  (((uint64_t)n) << 30)
+#define Terabytes(n)  (((uint64_t)n) << 40)
+
+// NOTE(ricardo): Pages are committed in chunks of this size as the arena grows
+#define ARENA_COMMIT_GRANULARITY Kilobytes(64)
+
+enum ArenaTag
+{
+  ArenaTag_General,
+  ArenaTag_Assets,
+  ArenaTag_Renderer,
+  ArenaTag_Scratch,
+  ArenaTag_Frame,
+  ArenaTag_Count
+};
+
+// NOTE(ricardo): Large pages are a request, if the OS can't give them to us the
+// arena silently falls back to normal pages and the flag gets cleared
+enum ArenaFlags
+{
+  ArenaFlag_None = 0,
+  ArenaFlag_LargePages = 1 << 0, // 2 MB pages, MAP_HUGETLB or transparent huge pages
+  ArenaFlag_HugeTLB = 1 << 1,    // Set by arena_alloc_flags when MAP_HUGETLB worked
+};
+
+#define ARENA_LARGE_PAGE_SIZE Megabytes(2)
 
 // Linear Allocator
 // Credits to gingerBill and RyanFleury
+// The capacity is only reserved address space, pages get committed on demand
+// when curr_offset grows past commit_offset.
 struct Arena
 {
   unsigned char* mem_base;
   size_t mem_length;
   size_t curr_offset;
+  size_t commit_offset;
+  // Everything past this offset is still fresh zeroed pages from the OS
+  size_t dirty_offset;
+  size_t commit_granularity;
+  uint32_t flags;
+
+  // Debug info, shown in the Metrics/Debugger window
+  const char* name;
+  ArenaTag tag;
+  size_t peak_offset;
+  uint64_t alloc_count;
+  Arena* debug_next;
 };
 
-Arena* arena_alloc(size_t capacity);
+Arena* arena_alloc(size_t capacity, const char* name, ArenaTag tag);
+Arena* arena_alloc_flags(size_t capacity, const char* name, ArenaTag tag, uint32_t flags);
 void arena_release(Arena* arena);
 
+// Zeroes the memory it returns, only the part that was used before gets a
+// memset since freshly committed pages are already zero
 void* arena_push(Arena* arena, size_t size);
 void* arena_push_align(Arena* arena, size_t size, size_t align);
+// Leaves the memory as is, use it when the caller overwrites all of it
+void* arena_push_no_zero(Arena* arena, size_t size);
+void* arena_push_align_no_zero(Arena* arena, size_t size, size_t align);
+void arena_pop_to(Arena* arena, size_t pos);
+void arena_reset(Arena* arena);
+void arena_decommit(Arena* arena, size_t offset);
 
-#define ARRAY_PUSH(flat_array, count) &flat_array[count++];
+// Copy of an arena's debug info, the arena itself can be released by its
+// thread any time after the snapshot
+struct ArenaDebugInfo
+{
+  const void* id; // The arena's address, only good for telling them apart
+  const char* name;
+  ArenaTag tag;
+  uint32_t flags;
+  size_t curr_offset;
+  size_t peak_offset;
+  size_t commit_offset;
+  size_t mem_length;
+  uint64_t alloc_count;
+};
+
+// Copies up to max_count live arenas, newest first, and returns how many
+uint32_t arena_debug_snapshot(ArenaDebugInfo* out, uint32_t max_count);
+const char* arena_tag_name(ArenaTag tag);
+
+// Temporary Memory
+// Marks the current offset of an arena, ending it rolls the arena back
+struct TempArena
+{
+  Arena* arena;
+  size_t pos;
+};
+
+TempArena temp_arena_begin(Arena* arena);
+void temp_arena_end(TempArena temp);
+
+// Scratch Arenas
+// Per-thread pool of arenas that are reused across calls. Pass the arenas
+// you are already allocating into as conflicts so that you never get back
+// the same arena your caller is using.
+#define SCRATCH_ARENA_COUNT 2
+#define SCRATCH_ARENA_RESERVE Gigabytes(1)
+
+TempArena scratch_begin(Arena** conflicts, uint32_t conflict_count);
+void scratch_end(TempArena scratch);
+
+// Frame Arenas
+// One arena per frame in flight, the one for the new frame gets reset at
+// frame_begin. Memory pushed into it is valid until the same slot comes
+// around again, so data can be handed to the next frame if needed.
+#define FRAMES_IN_FLIGHT 2
+#define FRAME_ARENA_RESERVE Gigabytes(1)
+
+void frame_arenas_init();
+void frame_begin();
+Arena* frame_arena();
+Arena* previous_frame_arena();
+
+// Pool Allocator
+// Fixed-size elements carved out of a dedicated arena so elements of the same
+// type stay contiguous. Freed elements go into a free list and get reused,
+// both push and free are O(1).
+struct PoolFreeNode
+{
+  PoolFreeNode* next;
+};
+
+struct Pool
+{
+  Arena* arena;
+  size_t element_size;
+  PoolFreeNode* free_list;
+  uint32_t count;
+};
+
+Pool* pool_alloc(size_t element_size, size_t capacity, const char* name, ArenaTag tag);
+void* pool_push(Pool* pool);
+void pool_free(Pool* pool, void* element);
+void pool_release(Pool* pool);
+
+#define POOL_PUSH(pool, type) (type*)pool_push(pool)
+
+// Concurrent Arena
+// Threads reserve sub-blocks with an atomic fetch-add and then bump allocate
+// inside their own block without touching shared state. Each thread keeps a
+// ConcurrentArenaBlock cursor, the plain Arena stays the single threaded path.
+#define CONCURRENT_ARENA_BLOCK_SIZE Kilobytes(64)
+
+struct ConcurrentArena
+{
+  unsigned char* mem_base;
+  size_t mem_length;
+  std::atomic<size_t> curr_offset;
+  // Only written by concurrent_arena_reset while nobody is pushing
+  size_t dirty_offset;
+  size_t page_size;
+  const char* name;
+};
+
+struct ConcurrentArenaBlock
+{
+  ConcurrentArena* arena;
+  size_t offset;
+  size_t end;
+};
+
+ConcurrentArena* concurrent_arena_alloc(size_t capacity, const char* name);
+ConcurrentArenaBlock concurrent_arena_block(ConcurrentArena* arena);
+void* concurrent_arena_push(ConcurrentArenaBlock* block, size_t size);
+void* concurrent_arena_push_align(ConcurrentArenaBlock* block, size_t size, size_t align);
+void concurrent_arena_reset(ConcurrentArena* arena);
+void concurrent_arena_release(ConcurrentArena* arena);
+
+// Growable Array
+// Grows in place when it is the last allocation of its arena, otherwise it
+// moves to a new block at the end of the arena (old block is left behind).
+template<typename T>
+struct Array
+{
+  Arena* arena;
+  T* data;
+  uint64_t count;
+  uint64_t capacity;
+
+  T& operator[](uint64_t index);
+};
+
+template<typename T> Array<T> array_init(Arena* arena, uint64_t capacity);
+template<typename T> void array_reserve(Array<T>* array, uint64_t capacity);
+template<typename T> T* array_push(Array<T>* array, const T& value);
+
+// Strings
+// Not owning view into some memory, not necessarily null terminated unless
+// it came from one of the str_push functions
+struct StringView
+{
+  const char* data;
+  uint64_t size;
+};
+
+StringView str_view(const char* cstr);
+StringView str_view(const char* data, uint64_t size);
+bool str_equal(StringView a, StringView b);
+StringView str_push_copy(Arena* arena, StringView str);
+StringView str_push_concat(Arena* arena, StringView a, StringView b);
+StringView str_push_fmt(Arena* arena, const char* fmt, ...);
+StringView str_chop_last_slash(StringView str);
+StringView str_push_normalized_path(Arena* arena, StringView path);
+
+// Builds a string by appending to an arena-backed char array
+struct StringBuilder
+{
+  Array<char> chars;
+};
+
+StringBuilder str_builder_init(Arena* arena, uint64_t capacity);
+void str_builder_append(StringBuilder* builder, StringView str);
+StringView str_builder_view(StringBuilder* builder);
+
+// Hashing
+uint64_t hash_bytes(const void* data, uint64_t size);
+template<typename K> uint64_t hash_key(const K& key);
+uint64_t hash_key(const StringView& key);
+template<typename K> bool key_equal(const K& a, const K& b);
+bool key_equal(const StringView& a, const StringView& b);
+
+// Hash Map
+// Open addressing with linear probing, capacity is always a power of two.
+// Entries can't be removed, the map goes away with its arena.
+template<typename K, typename V>
+struct HashMap
+{
+  Arena* arena;
+  K* keys;
+  V* values;
+  uint8_t* occupied;
+  uint64_t count;
+  uint64_t capacity;
+};
+
+template<typename K, typename V> HashMap<K, V> hash_map_init(Arena* arena, uint64_t capacity);
+template<typename K, typename V> V* hash_map_get(HashMap<K, V>* map, const K& key);
+template<typename K, typename V> V* hash_map_put(HashMap<K, V>* map, const K& key, const V& value);
+
+// Heap Allocation Tracker
+// Fed by the global operator new/delete hooks. Each thread bumps its own
+// counters (single writer, so no locked instructions) and once per frame
+// the main thread sums them up. One in ALLOC_SAMPLE_RATE allocations also
+// records its call stack into a small ring buffer.
+#define ALLOC_SAMPLE_RATE 1024
+#define ALLOC_SAMPLE_MAX_FRAMES 16
+#define ALLOC_SAMPLE_COUNT 64
 
+struct AllocStats
+{
+  uint64_t alloc_count;
+  uint64_t alloc_bytes;
+  uint64_t free_count;
+  uint64_t free_bytes;
+};
+
+struct AllocSample
+{
+  size_t size;
+  uint64_t frame_index;
+  uint32_t frame_count;
+  void* frames[ALLOC_SAMPLE_MAX_FRAMES];
+};
+
+void alloc_tracker_on_alloc(void* ptr);
+void alloc_tracker_on_free(void* ptr);
+AllocStats alloc_tracker_totals();
+AllocStats alloc_tracker_frame_end();
+uint64_t alloc_tracker_frame_index();
+uint32_t alloc_tracker_samples(AllocSample* out, uint32_t max_count);
+void alloc_sample_symbol(void* address, char* buffer, size_t size);
+
+#define ARRAY_PUSH(flat_array, count) &flat_array[count++];
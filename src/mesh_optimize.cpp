@@ -0,0 +1,971 @@
+// #include "mesh_optimize.h"
+#include <algorithm>
+#include <float.h>
+#include <math.h>
+#include <stdint.h>
+#include <string.h>
+
+// NOTE(ricardo): unity build, the header is documentation only
+#define MESH_OPTIMIZE_CACHE_SIZE 16
+#define MESH_OPTIMIZE_OVERDRAW_THRESHOLD 1.05f
+#define MESHLET_MAX_VERTICES 64
+#define MESHLET_MAX_TRIANGLES 124
+
+struct VertexCacheStats
+{
+  uint64_t misses;
+  uint64_t num_triangles;
+  uint64_t num_vertices;
+};
+
+// FIFO through timestamps: the clock only ticks on a miss, so a vertex is
+// still cached while fewer than cache_size misses happened since it got in
+struct VertexCacheSim
+{
+  uint32_t* stamps;
+  uint32_t cache_size;
+  uint32_t clock;
+};
+
+static VertexCacheSim vertex_cache_sim_init(Arena* arena, uint64_t num_vertices, uint32_t cache_size)
+{
+  VertexCacheSim sim = {};
+  sim.stamps = (uint32_t*)arena_push(arena, num_vertices * sizeof(uint32_t));
+  sim.cache_size = cache_size;
+  sim.clock = cache_size + 1;
+  return sim;
+}
+
+static uint32_t vertex_cache_sim_triangle(VertexCacheSim* sim, const uint32_t* triangle)
+{
+  uint32_t misses = 0;
+  for (int i = 0; i < 3; i++)
+  {
+    uint32_t vertex = triangle[i];
+    if (sim->clock - sim->stamps[vertex] > sim->cache_size)
+    {
+      sim->stamps[vertex] = sim->clock++;
+      misses++;
+    }
+  }
+  return misses;
+}
+
+static void vertex_cache_sim_flush(VertexCacheSim* sim)
+{
+  sim->clock += sim->cache_size + 1;
+}
+
+VertexCacheStats mesh_analyze_vertex_cache(const uint32_t* indices, uint64_t num_indices, uint64_t num_vertices,
+    uint32_t cache_size)
+{
+  TempArena scratch = scratch_begin(0, 0);
+  VertexCacheSim sim = vertex_cache_sim_init(scratch.arena, num_vertices, cache_size);
+  VertexCacheStats stats = {};
+  stats.num_triangles = num_indices / 3;
+  stats.num_vertices = num_vertices;
+  for (uint64_t i = 0; i + 2 < num_indices; i += 3)
+    stats.misses += vertex_cache_sim_triangle(&sim, indices + i);
+  scratch_end(scratch);
+  return stats;
+}
+
+float vertex_cache_acmr(VertexCacheStats stats)
+{
+  return stats.num_triangles ? (float)stats.misses / stats.num_triangles : 0.0f;
+}
+
+float vertex_cache_atvr(VertexCacheStats stats)
+{
+  return stats.num_vertices ? (float)stats.misses / stats.num_vertices : 0.0f;
+}
+
+// Tipsify
+// Fans around one vertex at a time and then moves to the neighbour that is
+// still in the cache and has the fewest triangles left, so a vertex tends to
+// be finished before it falls out. Dead ends go back through the recently
+// used vertices first and only then scan for any vertex with work left.
+uint64_t mesh_optimize_vertex_cache(uint32_t* indices, uint64_t num_indices, uint64_t num_vertices,
+    uint32_t* clusters)
+{
+  uint64_t num_triangles = num_indices / 3;
+  if (num_triangles == 0)
+    return 0;
+
+  TempArena scratch = scratch_begin(0, 0);
+  Arena* arena = scratch.arena;
+
+  // Vertex -> triangles adjacency, offsets has one extra entry at the end
+  uint32_t* live = (uint32_t*)arena_push(arena, num_vertices * sizeof(uint32_t));
+  for (uint64_t i = 0; i < num_triangles * 3; i++)
+    live[indices[i]]++;
+  uint32_t* offsets = (uint32_t*)arena_push(arena, (num_vertices + 1) * sizeof(uint32_t));
+  uint32_t max_valence = 0;
+  for (uint64_t v = 0; v < num_vertices; v++)
+  {
+    offsets[v + 1] = offsets[v] + live[v];
+    max_valence = live[v] > max_valence ? live[v] : max_valence;
+  }
+  uint32_t* adjacency = (uint32_t*)arena_push_no_zero(arena, num_triangles * 3 * sizeof(uint32_t));
+  uint32_t* fill = (uint32_t*)arena_push_no_zero(arena, num_vertices * sizeof(uint32_t));
+  memcpy(fill, offsets, num_vertices * sizeof(uint32_t));
+  for (uint64_t t = 0; t < num_triangles; t++)
+  {
+    for (int c = 0; c < 3; c++)
+      adjacency[fill[indices[t * 3 + c]]++] = (uint32_t)t;
+  }
+
+  uint32_t* stamps = (uint32_t*)arena_push(arena, num_vertices * sizeof(uint32_t));
+  uint8_t* emitted = (uint8_t*)arena_push(arena, num_triangles);
+  uint32_t* dead_ends = (uint32_t*)arena_push_no_zero(arena, num_triangles * 3 * sizeof(uint32_t));
+  uint64_t num_dead_ends = 0;
+  uint32_t* candidates = (uint32_t*)arena_push_no_zero(arena, (uint64_t)max_valence * 3 * sizeof(uint32_t));
+  uint32_t* result = (uint32_t*)arena_push_no_zero(arena, num_triangles * 3 * sizeof(uint32_t));
+  uint64_t num_result = 0;
+  uint64_t num_clusters = 0;
+
+  const uint32_t cache_size = MESH_OPTIMIZE_CACHE_SIZE;
+  uint32_t clock = cache_size + 1;
+  uint64_t cursor = 0;
+  int64_t fan = 0;
+  bool jumped = true;
+  while (fan >= 0)
+  {
+    if (jumped && (num_clusters == 0 || clusters[num_clusters - 1] != num_result / 3))
+      clusters[num_clusters++] = (uint32_t)(num_result / 3);
+    jumped = false;
+
+    uint32_t num_candidates = 0;
+    for (uint32_t a = offsets[fan]; a < offsets[fan + 1]; a++)
+    {
+      uint32_t t = adjacency[a];
+      if (emitted[t])
+        continue;
+      emitted[t] = 1;
+      for (int c = 0; c < 3; c++)
+      {
+        uint32_t v = indices[t * 3 + c];
+        result[num_result++] = v;
+        dead_ends[num_dead_ends++] = v;
+        candidates[num_candidates++] = v;
+        live[v]--;
+        if (clock - stamps[v] > cache_size)
+          stamps[v] = clock++;
+      }
+    }
+
+    // Neighbour that stays in the cache after its remaining fan, oldest first
+    int64_t next = -1;
+    int64_t best_priority = -1;
+    for (uint32_t i = 0; i < num_candidates; i++)
+    {
+      uint32_t v = candidates[i];
+      if (live[v] == 0)
+        continue;
+      int64_t priority = 0;
+      if (clock - stamps[v] + 2 * live[v] <= cache_size)
+        priority = clock - stamps[v];
+      if (priority > best_priority)
+      {
+        best_priority = priority;
+        next = v;
+      }
+    }
+
+    if (next < 0)
+    {
+      jumped = true;
+      while (num_dead_ends > 0 && next < 0)
+      {
+        uint32_t v = dead_ends[--num_dead_ends];
+        if (live[v] > 0)
+          next = v;
+      }
+      while (cursor < num_vertices && next < 0)
+      {
+        if (live[cursor] > 0)
+          next = (int64_t)cursor;
+        cursor++;
+      }
+    }
+    fan = next;
+  }
+
+  memcpy(indices, result, num_triangles * 3 * sizeof(uint32_t));
+  scratch_end(scratch);
+  return num_clusters;
+}
+
+struct MeshCluster
+{
+  float sort_key;
+  uint32_t first_triangle;
+  uint32_t num_triangles;
+};
+
+// NOTE(ricardo): Sander's linear-speed overdraw ordering. Tipsify clusters are
+// split again wherever the cluster's ACMR so far is already within the
+// threshold of the whole mesh, then clusters that face away from the center
+// go first since they are the ones that tend to occlude the rest.
+void mesh_optimize_overdraw(uint32_t* indices, uint64_t num_indices, const float* positions, size_t position_stride,
+    uint64_t num_vertices, const uint32_t* clusters, uint64_t num_clusters)
+{
+  uint64_t num_triangles = num_indices / 3;
+  if (num_triangles == 0 || num_clusters == 0)
+    return;
+
+  TempArena scratch = scratch_begin(0, 0);
+  Arena* arena = scratch.arena;
+  float target_acmr = vertex_cache_acmr(
+      mesh_analyze_vertex_cache(indices, num_indices, num_vertices, MESH_OPTIMIZE_CACHE_SIZE)) *
+    MESH_OPTIMIZE_OVERDRAW_THRESHOLD;
+
+  MeshCluster* soft_clusters = (MeshCluster*)arena_push_no_zero(arena, num_triangles * sizeof(MeshCluster));
+  uint64_t num_soft_clusters = 0;
+  VertexCacheSim sim = vertex_cache_sim_init(arena, num_vertices, MESH_OPTIMIZE_CACHE_SIZE);
+  for (uint64_t c = 0; c < num_clusters; c++)
+  {
+    uint32_t end = c + 1 < num_clusters ? clusters[c + 1] : (uint32_t)num_triangles;
+    uint32_t start = clusters[c];
+    uint64_t misses = 0;
+    vertex_cache_sim_flush(&sim);
+    for (uint32_t t = clusters[c]; t < end; t++)
+    {
+      misses += vertex_cache_sim_triangle(&sim, indices + t * 3);
+      if (t + 1 < end && misses <= target_acmr * (t - start + 1))
+      {
+        soft_clusters[num_soft_clusters++] = {0.0f, start, t + 1 - start};
+        start = t + 1;
+        misses = 0;
+        vertex_cache_sim_flush(&sim);
+      }
+    }
+    soft_clusters[num_soft_clusters++] = {0.0f, start, end - start};
+  }
+
+  // Area weighted centroid and normal of every cluster
+  float mesh_center[3] = {};
+  float mesh_area = 0.0f;
+  float* cluster_data = (float*)arena_push(arena, num_soft_clusters * 7 * sizeof(float));
+  for (uint64_t c = 0; c < num_soft_clusters; c++)
+  {
+    float* data = cluster_data + c * 7; // center xyz, normal xyz, area
+    MeshCluster* cluster = soft_clusters + c;
+    for (uint32_t t = cluster->first_triangle; t < cluster->first_triangle + cluster->num_triangles; t++)
+    {
+      const float* p0 = (const float*)((const char*)positions + indices[t * 3 + 0] * position_stride);
+      const float* p1 = (const float*)((const char*)positions + indices[t * 3 + 1] * position_stride);
+      const float* p2 = (const float*)((const char*)positions + indices[t * 3 + 2] * position_stride);
+      float e1[3] = {p1[0] - p0[0], p1[1] - p0[1], p1[2] - p0[2]};
+      float e2[3] = {p2[0] - p0[0], p2[1] - p0[1], p2[2] - p0[2]};
+      float normal[3] = {e1[1] * e2[2] - e1[2] * e2[1], e1[2] * e2[0] - e1[0] * e2[2], e1[0] * e2[1] - e1[1] * e2[0]};
+      float area = sqrtf(normal[0] * normal[0] + normal[1] * normal[1] + normal[2] * normal[2]);
+      for (int k = 0; k < 3; k++)
+      {
+        data[k] += (p0[k] + p1[k] + p2[k]) * (1.0f / 3.0f) * area;
+        data[3 + k] += normal[k];
+      }
+      data[6] += area;
+    }
+    for (int k = 0; k < 3; k++)
+      mesh_center[k] += data[k];
+    mesh_area += data[6];
+  }
+  for (int k = 0; k < 3; k++)
+    mesh_center[k] = mesh_area > 0.0f ? mesh_center[k] / mesh_area : 0.0f;
+
+  for (uint64_t c = 0; c < num_soft_clusters; c++)
+  {
+    float* data = cluster_data + c * 7;
+    float normal_length = sqrtf(data[3] * data[3] + data[4] * data[4] + data[5] * data[5]);
+    float key = 0.0f;
+    if (data[6] > 0.0f && normal_length > 0.0f)
+    {
+      for (int k = 0; k < 3; k++)
+        key += (data[k] / data[6] - mesh_center[k]) * data[3 + k];
+      key /= normal_length;
+    }
+    soft_clusters[c].sort_key = key;
+  }
+  std::stable_sort(soft_clusters, soft_clusters + num_soft_clusters,
+      [](const MeshCluster& a, const MeshCluster& b) { return a.sort_key > b.sort_key; });
+
+  uint32_t* result = (uint32_t*)arena_push_no_zero(arena, num_triangles * 3 * sizeof(uint32_t));
+  uint64_t num_result = 0;
+  for (uint64_t c = 0; c < num_soft_clusters; c++)
+  {
+    MeshCluster* cluster = soft_clusters + c;
+    memcpy(result + num_result, indices + cluster->first_triangle * 3, cluster->num_triangles * 3 * sizeof(uint32_t));
+    num_result += cluster->num_triangles * 3;
+  }
+  memcpy(indices, result, num_triangles * 3 * sizeof(uint32_t));
+  scratch_end(scratch);
+}
+
+// Renumbers vertices in the order the indices first touch them, vertices no
+// triangle uses end up at the back
+void mesh_optimize_vertex_fetch(void* vertices, size_t vertex_size, uint64_t num_vertices, uint32_t* indices,
+    uint64_t num_indices)
+{
+  TempArena scratch = scratch_begin(0, 0);
+  uint32_t* remap = (uint32_t*)arena_push_no_zero(scratch.arena, num_vertices * sizeof(uint32_t));
+  memset(remap, 0xFF, num_vertices * sizeof(uint32_t));
+  uint32_t next = 0;
+  for (uint64_t i = 0; i < num_indices; i++)
+  {
+    uint32_t v = indices[i];
+    if (remap[v] == UINT32_MAX)
+      remap[v] = next++;
+    indices[i] = remap[v];
+  }
+  for (uint64_t v = 0; v < num_vertices; v++)
+  {
+    if (remap[v] == UINT32_MAX)
+      remap[v] = next++;
+  }
+
+  unsigned char* source = (unsigned char*)vertices;
+  unsigned char* result = (unsigned char*)arena_push_no_zero(scratch.arena, num_vertices * vertex_size);
+  for (uint64_t v = 0; v < num_vertices; v++)
+    memcpy(result + remap[v] * vertex_size, source + v * vertex_size, vertex_size);
+  memcpy(vertices, result, num_vertices * vertex_size);
+  scratch_end(scratch);
+}
+
+// Quadric Simplification
+// Garland and Heckbert edge collapse, but u always collapses onto its
+// neighbour v instead of a new optimal position. The LOD keeps indexing the
+// same vertex buffer and every vertex keeps its attributes. Vertices at the
+// same position (uv or normal seams) share one quadric and move together:
+// seam vertices only slide along the seam with their twin, border vertices
+// only along the border, anything more tangled never moves.
+enum SimplifyVertexKind
+{
+  SimplifyVertexKind_Manifold,
+  SimplifyVertexKind_Border,
+  SimplifyVertexKind_Seam,
+  SimplifyVertexKind_Locked
+};
+
+#define SIMPLIFY_NO_EDGE UINT32_MAX
+#define SIMPLIFY_MANY_EDGES (UINT32_MAX - 1)
+// Open edges get a plane perpendicular to their triangle, weighted this much
+// more than the surface so borders and seams keep their shape
+#define SIMPLIFY_EDGE_WEIGHT 10.0
+// Collapses that turn a remaining triangle by more than ~75 degrees are flips
+#define SIMPLIFY_FLIP_COS 0.25
+
+struct SimplifyPosition
+{
+  float x;
+  float y;
+  float z;
+
+  bool operator==(const SimplifyPosition& other) const
+  {
+    return x == other.x && y == other.y && z == other.z;
+  }
+};
+
+// Sum of squared distances to planes, symmetric A, b and c of
+// p^T A p + 2 b.p + c. Doubles since far away planes cancel out a lot.
+struct Quadric
+{
+  double a00, a11, a22, a01, a02, a12;
+  double b0, b1, b2;
+  double c;
+  double weight;
+};
+
+struct SimplifyCollapse
+{
+  double error;
+  uint32_t from;
+  uint32_t to;
+};
+
+static const float* mesh_position(const float* positions, size_t position_stride, uint32_t vertex)
+{
+  return (const float*)((const char*)positions + vertex * position_stride);
+}
+
+static void quadric_add_plane(Quadric* q, const double* normal, double distance, double weight)
+{
+  q->a00 += normal[0] * normal[0] * weight;
+  q->a11 += normal[1] * normal[1] * weight;
+  q->a22 += normal[2] * normal[2] * weight;
+  q->a01 += normal[0] * normal[1] * weight;
+  q->a02 += normal[0] * normal[2] * weight;
+  q->a12 += normal[1] * normal[2] * weight;
+  q->b0 += normal[0] * distance * weight;
+  q->b1 += normal[1] * distance * weight;
+  q->b2 += normal[2] * distance * weight;
+  q->c += distance * distance * weight;
+  q->weight += weight;
+}
+
+static void quadric_add(Quadric* q, const Quadric* other)
+{
+  q->a00 += other->a00;
+  q->a11 += other->a11;
+  q->a22 += other->a22;
+  q->a01 += other->a01;
+  q->a02 += other->a02;
+  q->a12 += other->a12;
+  q->b0 += other->b0;
+  q->b1 += other->b1;
+  q->b2 += other->b2;
+  q->c += other->c;
+  q->weight += other->weight;
+}
+
+// Weighted mean squared distance to the planes
+static double quadric_error(const Quadric* q, const float* p)
+{
+  double x = p[0];
+  double y = p[1];
+  double z = p[2];
+  double rx = q->a00 * x + q->a01 * y + q->a02 * z;
+  double ry = q->a01 * x + q->a11 * y + q->a12 * z;
+  double rz = q->a02 * x + q->a12 * y + q->a22 * z;
+  double error = rx * x + ry * y + rz * z + 2.0 * (q->b0 * x + q->b1 * y + q->b2 * z) + q->c;
+  return error > 0.0 && q->weight > 0.0 ? error / q->weight : 0.0;
+}
+
+static void simplify_cross(const float* a, const float* b, const float* c, double* result)
+{
+  double e1[3] = {(double)b[0] - a[0], (double)b[1] - a[1], (double)b[2] - a[2]};
+  double e2[3] = {(double)c[0] - a[0], (double)c[1] - a[1], (double)c[2] - a[2]};
+  result[0] = e1[1] * e2[2] - e1[2] * e2[1];
+  result[1] = e1[2] * e2[0] - e1[0] * e2[2];
+  result[2] = e1[0] * e2[1] - e1[1] * e2[0];
+}
+
+// Vertex -> triangle adjacency of the current indices, same layout as Tipsify
+struct MeshAdjacency
+{
+  uint32_t* offsets;
+  uint32_t* triangles;
+};
+
+static MeshAdjacency mesh_build_adjacency(Arena* arena, const uint32_t* indices, uint64_t num_indices,
+    uint64_t num_vertices)
+{
+  MeshAdjacency adjacency = {};
+  adjacency.offsets = (uint32_t*)arena_push(arena, (num_vertices + 1) * sizeof(uint32_t));
+  adjacency.triangles = (uint32_t*)arena_push_no_zero(arena, num_indices * sizeof(uint32_t));
+  for (uint64_t i = 0; i < num_indices; i++)
+    adjacency.offsets[indices[i] + 1]++;
+  for (uint64_t v = 0; v < num_vertices; v++)
+    adjacency.offsets[v + 1] += adjacency.offsets[v];
+  uint32_t* fill = (uint32_t*)arena_push_no_zero(arena, num_vertices * sizeof(uint32_t));
+  memcpy(fill, adjacency.offsets, num_vertices * sizeof(uint32_t));
+  for (uint64_t i = 0; i < num_indices; i++)
+    adjacency.triangles[fill[indices[i]]++] = (uint32_t)(i / 3);
+  return adjacency;
+}
+
+// Whether some triangle has the directed edge from -> to
+static bool simplify_has_edge(const MeshAdjacency* adjacency, const uint32_t* indices, uint32_t from, uint32_t to)
+{
+  for (uint32_t a = adjacency->offsets[from]; a < adjacency->offsets[from + 1]; a++)
+  {
+    const uint32_t* triangle = indices + adjacency->triangles[a] * 3;
+    for (int c = 0; c < 3; c++)
+    {
+      if (triangle[c] == from && triangle[(c + 1) % 3] == to)
+        return true;
+    }
+  }
+  return false;
+}
+
+// Moving from onto the position of to, true if a triangle that survives the
+// collapse would turn around
+static bool simplify_collapse_flips(const MeshAdjacency* adjacency, const uint32_t* indices,
+    const float* positions, size_t position_stride, const uint32_t* remap, uint32_t from, uint32_t to)
+{
+  const float* target = mesh_position(positions, position_stride, to);
+  for (uint32_t a = adjacency->offsets[from]; a < adjacency->offsets[from + 1]; a++)
+  {
+    const uint32_t* triangle = indices + adjacency->triangles[a] * 3;
+    int corner = triangle[0] == from ? 0 : (triangle[1] == from ? 1 : 2);
+    uint32_t b = triangle[(corner + 1) % 3];
+    uint32_t c = triangle[(corner + 2) % 3];
+    if (remap[b] == remap[to] || remap[c] == remap[to])
+      continue;
+
+    const float* pb = mesh_position(positions, position_stride, b);
+    const float* pc = mesh_position(positions, position_stride, c);
+    double before[3];
+    double after[3];
+    simplify_cross(mesh_position(positions, position_stride, from), pb, pc, before);
+    simplify_cross(target, pb, pc, after);
+    double dot = before[0] * after[0] + before[1] * after[1] + before[2] * after[2];
+    double before_length = sqrt(before[0] * before[0] + before[1] * before[1] + before[2] * before[2]);
+    double after_length = sqrt(after[0] * after[0] + after[1] * after[1] + after[2] * after[2]);
+    // NOTE(ricardo): a triangle squashed flat counts too, once it has no
+    // normal nothing stops a later collapse from turning it over
+    if (before_length > 0.0 && dot <= SIMPLIFY_FLIP_COS * before_length * after_length)
+      return true;
+  }
+  return false;
+}
+
+static void simplify_lock_ring(const MeshAdjacency* adjacency, const uint32_t* indices, const uint32_t* remap,
+    uint32_t vertex, uint8_t* locked)
+{
+  for (uint32_t a = adjacency->offsets[vertex]; a < adjacency->offsets[vertex + 1]; a++)
+  {
+    const uint32_t* triangle = indices + adjacency->triangles[a] * 3;
+    for (int c = 0; c < 3; c++)
+      locked[remap[triangle[c]]] = 1;
+  }
+}
+
+// The vertex next to twin along its open edges that sits where to sits
+static uint32_t simplify_seam_target(const uint32_t* remap, const uint32_t* open_in, const uint32_t* open_out,
+    uint32_t twin, uint32_t to)
+{
+  if (open_in[twin] < SIMPLIFY_MANY_EDGES && remap[open_in[twin]] == remap[to])
+    return open_in[twin];
+  if (open_out[twin] < SIMPLIFY_MANY_EDGES && remap[open_out[twin]] == remap[to])
+    return open_out[twin];
+  return SIMPLIFY_NO_EDGE;
+}
+
+uint64_t mesh_simplify(uint32_t* destination, const uint32_t* indices, uint64_t num_indices, const float* positions,
+    size_t position_stride, uint64_t num_vertices, uint64_t target_index_count, float target_error,
+    float* result_error)
+{
+  TempArena scratch = scratch_begin(0, 0);
+  Arena* arena = scratch.arena;
+  uint64_t num_result = num_indices - num_indices % 3;
+  uint32_t* result = destination;
+  memmove(result, indices, num_result * sizeof(uint32_t));
+
+  // Vertices at the same position, remap points at the first one and twins
+  // form a ring. Only vertices the indices use take part.
+  uint32_t* remap = (uint32_t*)arena_push_no_zero(arena, num_vertices * sizeof(uint32_t));
+  uint32_t* twins = (uint32_t*)arena_push_no_zero(arena, num_vertices * sizeof(uint32_t));
+  uint8_t* used = (uint8_t*)arena_push(arena, num_vertices);
+  for (uint64_t i = 0; i < num_result; i++)
+    used[result[i]] = 1;
+  HashMap<SimplifyPosition, uint32_t> first_at = hash_map_init<SimplifyPosition, uint32_t>(arena, num_vertices);
+  for (uint32_t v = 0; v < num_vertices; v++)
+  {
+    remap[v] = v;
+    twins[v] = v;
+    if (!used[v])
+      continue;
+    const float* p = mesh_position(positions, position_stride, v);
+    // NOTE(ricardo): + 0.0f turns -0.0f into 0.0f, the map hashes the bytes
+    SimplifyPosition key = {p[0] + 0.0f, p[1] + 0.0f, p[2] + 0.0f};
+    uint32_t* first = hash_map_get(&first_at, key);
+    if (first)
+    {
+      remap[v] = *first;
+      twins[v] = twins[*first];
+      twins[*first] = v;
+    }
+    else
+    {
+      hash_map_put(&first_at, key, v);
+    }
+  }
+
+  // One quadric per position, from the planes of the triangles around it
+  Quadric* quadrics = (Quadric*)arena_push(arena, num_vertices * sizeof(Quadric));
+  for (uint64_t i = 0; i < num_result; i += 3)
+  {
+    const float* p0 = mesh_position(positions, position_stride, result[i + 0]);
+    double normal[3];
+    simplify_cross(p0, mesh_position(positions, position_stride, result[i + 1]),
+        mesh_position(positions, position_stride, result[i + 2]), normal);
+    double length = sqrt(normal[0] * normal[0] + normal[1] * normal[1] + normal[2] * normal[2]);
+    if (length == 0.0)
+      continue;
+    for (int k = 0; k < 3; k++)
+      normal[k] /= length;
+    double distance = -(normal[0] * p0[0] + normal[1] * p0[1] + normal[2] * p0[2]);
+    for (int c = 0; c < 3; c++)
+      quadric_add_plane(&quadrics[remap[result[i + c]]], normal, distance, length * 0.5);
+  }
+
+  uint32_t* open_in = (uint32_t*)arena_push_no_zero(arena, num_vertices * sizeof(uint32_t));
+  uint32_t* open_out = (uint32_t*)arena_push_no_zero(arena, num_vertices * sizeof(uint32_t));
+  uint8_t* kinds = (uint8_t*)arena_push_no_zero(arena, num_vertices);
+  uint32_t* collapse_remap = (uint32_t*)arena_push_no_zero(arena, num_vertices * sizeof(uint32_t));
+  uint8_t* collapse_locked = (uint8_t*)arena_push_no_zero(arena, num_vertices);
+  SimplifyCollapse* collapses = (SimplifyCollapse*)arena_push_no_zero(arena,
+      num_result * sizeof(SimplifyCollapse));
+  uint64_t pass_pos = arena->curr_offset;
+
+  double max_error = 0.0;
+  uint64_t rank_scale = 1;
+  bool first_pass = true;
+  while (num_result > target_index_count)
+  {
+    arena_pop_to(arena, pass_pos);
+    MeshAdjacency adjacency = mesh_build_adjacency(arena, result, num_result, num_vertices);
+
+    // Open edges have no opposite half-edge, seams are open edges whose
+    // opposite exists once twins count as the same vertex
+    memset(open_in, 0xFF, num_vertices * sizeof(uint32_t));
+    memset(open_out, 0xFF, num_vertices * sizeof(uint32_t));
+    for (uint64_t i = 0; i < num_result; i++)
+    {
+      uint32_t a = result[i];
+      uint32_t b = result[i - i % 3 + (i + 1) % 3];
+      if (simplify_has_edge(&adjacency, result, b, a))
+        continue;
+      open_out[a] = open_out[a] == SIMPLIFY_NO_EDGE ? b : SIMPLIFY_MANY_EDGES;
+      open_in[b] = open_in[b] == SIMPLIFY_NO_EDGE ? a : SIMPLIFY_MANY_EDGES;
+
+      if (first_pass)
+      {
+        // Plane through the edge, perpendicular to its triangle
+        const float* pa = mesh_position(positions, position_stride, a);
+        const float* pb = mesh_position(positions, position_stride, b);
+        const float* pc = mesh_position(positions, position_stride, result[i - i % 3 + (i + 2) % 3]);
+        double normal[3];
+        simplify_cross(pa, pb, pc, normal);
+        double edge[3] = {(double)pb[0] - pa[0], (double)pb[1] - pa[1], (double)pb[2] - pa[2]};
+        double plane[3] = {edge[1] * normal[2] - edge[2] * normal[1], edge[2] * normal[0] - edge[0] * normal[2],
+          edge[0] * normal[1] - edge[1] * normal[0]};
+        double length = sqrt(plane[0] * plane[0] + plane[1] * plane[1] + plane[2] * plane[2]);
+        if (length == 0.0)
+          continue;
+        for (int k = 0; k < 3; k++)
+          plane[k] /= length;
+        double distance = -(plane[0] * pa[0] + plane[1] * pa[1] + plane[2] * pa[2]);
+        double weight = (edge[0] * edge[0] + edge[1] * edge[1] + edge[2] * edge[2]) * SIMPLIFY_EDGE_WEIGHT;
+        quadric_add_plane(&quadrics[remap[a]], plane, distance, weight);
+        quadric_add_plane(&quadrics[remap[b]], plane, distance, weight);
+      }
+    }
+    first_pass = false;
+
+    for (uint32_t v = 0; v < num_vertices; v++)
+    {
+      bool single_in = open_in[v] < SIMPLIFY_MANY_EDGES;
+      bool single_out = open_out[v] < SIMPLIFY_MANY_EDGES;
+      bool closed = open_in[v] == SIMPLIFY_NO_EDGE && open_out[v] == SIMPLIFY_NO_EDGE;
+      uint32_t twin = twins[v];
+      if (twin == v)
+      {
+        kinds[v] = closed ? SimplifyVertexKind_Manifold :
+          (single_in && single_out ? SimplifyVertexKind_Border : SimplifyVertexKind_Locked);
+      }
+      else if (twins[twin] == v && single_in && single_out && open_in[twin] < SIMPLIFY_MANY_EDGES &&
+          open_out[twin] < SIMPLIFY_MANY_EDGES && remap[open_out[v]] == remap[open_in[twin]] &&
+          remap[open_in[v]] == remap[open_out[twin]])
+      {
+        kinds[v] = SimplifyVertexKind_Seam;
+      }
+      else
+      {
+        kinds[v] = SimplifyVertexKind_Locked;
+      }
+    }
+
+    // Cheapest allowed direction of every edge
+    uint64_t num_collapses = 0;
+    for (uint64_t i = 0; i < num_result; i++)
+    {
+      uint32_t a = result[i];
+      uint32_t b = result[i - i % 3 + (i + 1) % 3];
+      // Interior edges show up twice, keep one
+      if (remap[a] == remap[b] || (a > b && simplify_has_edge(&adjacency, result, b, a)))
+        continue;
+
+      SimplifyCollapse best = {-1.0, 0, 0};
+      uint32_t ends[2] = {a, b};
+      for (int d = 0; d < 2; d++)
+      {
+        uint32_t from = ends[d];
+        uint32_t to = ends[1 - d];
+        uint8_t kind = kinds[from];
+        if (kind == SimplifyVertexKind_Locked)
+          continue;
+        if (kind != SimplifyVertexKind_Manifold && open_in[from] != to && open_out[from] != to)
+          continue;
+        if (kind == SimplifyVertexKind_Seam &&
+            simplify_seam_target(remap, open_in, open_out, twins[from], to) == SIMPLIFY_NO_EDGE)
+          continue;
+        Quadric q = quadrics[remap[from]];
+        quadric_add(&q, &quadrics[remap[to]]);
+        double error = quadric_error(&q, mesh_position(positions, position_stride, to));
+        if (best.error < 0.0 || error < best.error)
+          best = {error, from, to};
+      }
+      if (best.error >= 0.0)
+        collapses[num_collapses++] = best;
+    }
+    if (num_collapses == 0)
+      break;
+    std::sort(collapses, collapses + num_collapses,
+        [](const SimplifyCollapse& x, const SimplifyCollapse& y) { return x.error < y.error; });
+
+    // NOTE(ricardo): every collapse removes about two triangles, but each one
+    // locks its whole ring for the rest of the pass. Going a bit past the
+    // error of the collapse that would just reach the target keeps passes
+    // from stopping early without reaching for expensive collapses.
+    uint64_t collapse_goal = (num_result - target_index_count) / 6 + 1;
+    double error_limit = (double)target_error * target_error;
+    uint64_t limit_rank = collapse_goal * rank_scale;
+    if (limit_rank < num_collapses && collapses[limit_rank].error * 1.5 < error_limit)
+      error_limit = collapses[limit_rank].error * 1.5;
+
+    for (uint32_t v = 0; v < num_vertices; v++)
+      collapse_remap[v] = v;
+    memset(collapse_locked, 0, num_vertices);
+    uint64_t num_applied = 0;
+    for (uint64_t c = 0; c < num_collapses && num_applied < collapse_goal; c++)
+    {
+      SimplifyCollapse collapse = collapses[c];
+      if (collapse.error > error_limit)
+        break;
+      uint32_t from = collapse.from;
+      uint32_t to = collapse.to;
+      if (collapse_locked[remap[from]] || collapse_locked[remap[to]])
+        continue;
+      if (simplify_collapse_flips(&adjacency, result, positions, position_stride, remap, from, to))
+        continue;
+      uint32_t twin = twins[from];
+      uint32_t twin_to = SIMPLIFY_NO_EDGE;
+      if (kinds[from] == SimplifyVertexKind_Seam)
+      {
+        twin_to = simplify_seam_target(remap, open_in, open_out, twin, to);
+        if (simplify_collapse_flips(&adjacency, result, positions, position_stride, remap, twin, twin_to))
+          continue;
+      }
+
+      collapse_remap[from] = to;
+      if (twin_to != SIMPLIFY_NO_EDGE)
+        collapse_remap[twin] = twin_to;
+      quadric_add(&quadrics[remap[to]], &quadrics[remap[from]]);
+      // The flip test assumed the rest of every triangle around from stays put
+      simplify_lock_ring(&adjacency, result, remap, from, collapse_locked);
+      if (twin_to != SIMPLIFY_NO_EDGE)
+        simplify_lock_ring(&adjacency, result, remap, twin, collapse_locked);
+      max_error = collapse.error > max_error ? collapse.error : max_error;
+      num_applied++;
+    }
+    if (num_applied == 0)
+      break;
+    if (num_applied * 4 < collapse_goal && rank_scale < 64)
+      rank_scale *= 2;
+
+    // Triangles that lost an edge are gone
+    uint64_t write = 0;
+    for (uint64_t i = 0; i < num_result; i += 3)
+    {
+      uint32_t a = collapse_remap[result[i + 0]];
+      uint32_t b = collapse_remap[result[i + 1]];
+      uint32_t c = collapse_remap[result[i + 2]];
+      if (remap[a] == remap[b] || remap[b] == remap[c] || remap[a] == remap[c])
+        continue;
+      result[write++] = a;
+      result[write++] = b;
+      result[write++] = c;
+    }
+    num_result = write;
+  }
+
+  if (result_error)
+    *result_error = (float)sqrt(max_error);
+  scratch_end(scratch);
+  return num_result;
+}
+
+// Meshlets
+// Greedy: keep adding the unused triangle that shares the most vertices with
+// the meshlet being built, fall back to the next unused one in index order
+// (which already has vertex cache locality) when nothing is adjacent.
+// Normal cones wider than this (dot of axis and some normal below it) can't
+// be culled from anywhere useful, store them as never back facing
+#define MESHLET_MIN_CONE_DOT 0.1f
+
+struct Meshlet
+{
+  uint32_t first_triangle;
+  uint32_t num_triangles;
+  uint32_t num_vertices;
+  float center[3];
+  float radius;
+  float bounds_min[3];
+  float bounds_max[3];
+  float cone_axis[3];
+  float cone_cutoff;
+};
+
+uint64_t mesh_meshlet_bound(uint64_t num_indices)
+{
+  // A meshlet only closes early once it has at least MAX_VERTICES - 2
+  // vertices, which takes a third as many triangles
+  uint64_t min_triangles = (MESHLET_MAX_VERTICES - 2) / 3;
+  return num_indices / 3 / min_triangles + 1;
+}
+
+static void meshlet_compute_bounds(Meshlet* meshlet, const uint32_t* indices, const uint32_t* vertices,
+    const float* positions, size_t position_stride)
+{
+  for (int k = 0; k < 3; k++)
+  {
+    meshlet->bounds_min[k] = FLT_MAX;
+    meshlet->bounds_max[k] = -FLT_MAX;
+  }
+  for (uint32_t i = 0; i < meshlet->num_vertices; i++)
+  {
+    const float* p = mesh_position(positions, position_stride, vertices[i]);
+    for (int k = 0; k < 3; k++)
+    {
+      meshlet->bounds_min[k] = p[k] < meshlet->bounds_min[k] ? p[k] : meshlet->bounds_min[k];
+      meshlet->bounds_max[k] = p[k] > meshlet->bounds_max[k] ? p[k] : meshlet->bounds_max[k];
+    }
+  }
+  float radius_squared = 0.0f;
+  for (int k = 0; k < 3; k++)
+    meshlet->center[k] = (meshlet->bounds_min[k] + meshlet->bounds_max[k]) * 0.5f;
+  for (uint32_t i = 0; i < meshlet->num_vertices; i++)
+  {
+    const float* p = mesh_position(positions, position_stride, vertices[i]);
+    float d[3] = {p[0] - meshlet->center[0], p[1] - meshlet->center[1], p[2] - meshlet->center[2]};
+    float distance_squared = d[0] * d[0] + d[1] * d[1] + d[2] * d[2];
+    radius_squared = distance_squared > radius_squared ? distance_squared : radius_squared;
+  }
+  meshlet->radius = sqrtf(radius_squared);
+
+  // Axis is the average face normal, the cone has to contain all of them
+  float normals[MESHLET_MAX_TRIANGLES][3];
+  uint32_t num_normals = 0;
+  float axis[3] = {};
+  for (uint32_t t = 0; t < meshlet->num_triangles; t++)
+  {
+    const float* p0 = mesh_position(positions, position_stride, indices[t * 3 + 0]);
+    const float* p1 = mesh_position(positions, position_stride, indices[t * 3 + 1]);
+    const float* p2 = mesh_position(positions, position_stride, indices[t * 3 + 2]);
+    float e1[3] = {p1[0] - p0[0], p1[1] - p0[1], p1[2] - p0[2]};
+    float e2[3] = {p2[0] - p0[0], p2[1] - p0[1], p2[2] - p0[2]};
+    float* normal = normals[num_normals];
+    normal[0] = e1[1] * e2[2] - e1[2] * e2[1];
+    normal[1] = e1[2] * e2[0] - e1[0] * e2[2];
+    normal[2] = e1[0] * e2[1] - e1[1] * e2[0];
+    float length = sqrtf(normal[0] * normal[0] + normal[1] * normal[1] + normal[2] * normal[2]);
+    if (length == 0.0f)
+      continue;
+    for (int k = 0; k < 3; k++)
+    {
+      normal[k] /= length;
+      axis[k] += normal[k];
+    }
+    num_normals++;
+  }
+  float axis_length = sqrtf(axis[0] * axis[0] + axis[1] * axis[1] + axis[2] * axis[2]);
+  float min_dot = 1.0f;
+  for (int k = 0; k < 3; k++)
+    axis[k] = axis_length > 0.0f ? axis[k] / axis_length : 0.0f;
+  for (uint32_t n = 0; n < num_normals; n++)
+  {
+    float dot = normals[n][0] * axis[0] + normals[n][1] * axis[1] + normals[n][2] * axis[2];
+    min_dot = dot < min_dot ? dot : min_dot;
+  }
+  memcpy(meshlet->cone_axis, axis, sizeof(axis));
+  if (num_normals == 0 || min_dot < MESHLET_MIN_CONE_DOT)
+    meshlet->cone_cutoff = 1.0f;
+  else
+    meshlet->cone_cutoff = sqrtf(1.0f - min_dot * min_dot);
+}
+
+uint64_t mesh_build_meshlets(Meshlet* meshlets, uint32_t* indices, uint64_t num_indices, const float* positions,
+    size_t position_stride, uint64_t num_vertices)
+{
+  uint64_t num_triangles = num_indices / 3;
+  if (num_triangles == 0)
+    return 0;
+
+  TempArena scratch = scratch_begin(0, 0);
+  Arena* arena = scratch.arena;
+  MeshAdjacency adjacency = mesh_build_adjacency(arena, indices, num_indices, num_vertices);
+  // Triangles per vertex that still have to go into a meshlet
+  uint32_t* live = (uint32_t*)arena_push_no_zero(arena, num_vertices * sizeof(uint32_t));
+  for (uint64_t v = 0; v < num_vertices; v++)
+    live[v] = adjacency.offsets[v + 1] - adjacency.offsets[v];
+  // Meshlet index + 1 of the last meshlet that used the vertex
+  uint32_t* stamps = (uint32_t*)arena_push(arena, num_vertices * sizeof(uint32_t));
+  uint8_t* emitted = (uint8_t*)arena_push(arena, num_triangles);
+  uint32_t* result = (uint32_t*)arena_push_no_zero(arena, num_triangles * 3 * sizeof(uint32_t));
+  uint32_t vertices[MESHLET_MAX_VERTICES];
+
+  uint64_t num_meshlets = 0;
+  Meshlet* meshlet = meshlets;
+  *meshlet = {};
+  uint64_t cursor = 0;
+  for (uint64_t emitted_count = 0; emitted_count < num_triangles; emitted_count++)
+  {
+    uint32_t stamp = (uint32_t)num_meshlets + 1;
+    uint32_t best = UINT32_MAX;
+    int best_new = 4;
+    for (uint32_t i = 0; i < meshlet->num_vertices && best_new > 0; i++)
+    {
+      uint32_t v = vertices[i];
+      if (live[v] == 0)
+        continue;
+      for (uint32_t a = adjacency.offsets[v]; a < adjacency.offsets[v + 1]; a++)
+      {
+        uint32_t t = adjacency.triangles[a];
+        if (emitted[t])
+          continue;
+        int num_new = 0;
+        for (int c = 0; c < 3; c++)
+          num_new += stamps[indices[t * 3 + c]] != stamp;
+        if (num_new < best_new)
+        {
+          best = t;
+          best_new = num_new;
+        }
+      }
+    }
+    if (best == UINT32_MAX)
+    {
+      while (emitted[cursor])
+        cursor++;
+      best = (uint32_t)cursor;
+      best_new = 0;
+      for (int c = 0; c < 3; c++)
+        best_new += stamps[indices[best * 3 + c]] != stamp;
+    }
+
+    if (meshlet->num_triangles == MESHLET_MAX_TRIANGLES ||
+        meshlet->num_vertices + best_new > MESHLET_MAX_VERTICES)
+    {
+      meshlet_compute_bounds(meshlet, result + meshlet->first_triangle * 3, vertices, positions, position_stride);
+      uint32_t first_triangle = meshlet->first_triangle + meshlet->num_triangles;
+      meshlet = meshlets + ++num_meshlets;
+      *meshlet = {};
+      meshlet->first_triangle = first_triangle;
+      stamp++;
+    }
+
+    for (int c = 0; c < 3; c++)
+    {
+      uint32_t v = indices[best * 3 + c];
+      if (stamps[v] != stamp)
+      {
+        stamps[v] = stamp;
+        vertices[meshlet->num_vertices++] = v;
+      }
+      live[v]--;
+      result[(meshlet->first_triangle + meshlet->num_triangles) * 3 + c] = v;
+    }
+    emitted[best] = 1;
+    meshlet->num_triangles++;
+  }
+  meshlet_compute_bounds(meshlet, result + meshlet->first_triangle * 3, vertices, positions, position_stride);
+  num_meshlets++;
+
+  memcpy(indices, result, num_triangles * 3 * sizeof(uint32_t));
+  scratch_end(scratch);
+  return num_meshlets;
+}
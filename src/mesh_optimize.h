@@ -0,0 +1,77 @@
+#pragma once
+#include <stdint.h>
+#include <stddef.h>
+#include "memory.h"
+
+// Mesh Optimization
+// Index and vertex reordering for indexed triangle lists, none of it changes
+// what gets drawn:
+// - Tipsify (Sander et al. 2007) orders triangles for the post-transform
+//   vertex cache and marks the places where it had to jump as clusters.
+// - Clusters are split further while their ACMR stays close to the whole
+//   mesh and then sorted so outward facing ones come first (less overdraw).
+// - Vertices get renumbered in first use order for linear vertex fetch.
+// It also simplifies meshes for LODs that keep using the same vertices and
+// splits them into meshlets small enough to cull one by one.
+// Scratch memory comes from the calling thread's scratch arenas.
+#define MESH_OPTIMIZE_CACHE_SIZE 16
+#define MESH_OPTIMIZE_OVERDRAW_THRESHOLD 1.05f
+#define MESHLET_MAX_VERTICES 64
+#define MESHLET_MAX_TRIANGLES 124
+
+// FIFO cache simulation. ACMR is misses per triangle, ATVR misses per vertex
+// (1.0 is the best possible).
+struct VertexCacheStats
+{
+  uint64_t misses;
+  uint64_t num_triangles;
+  uint64_t num_vertices;
+};
+
+VertexCacheStats mesh_analyze_vertex_cache(const uint32_t* indices, uint64_t num_indices, uint64_t num_vertices,
+    uint32_t cache_size);
+float vertex_cache_acmr(VertexCacheStats stats);
+float vertex_cache_atvr(VertexCacheStats stats);
+
+// Tipsify, clusters gets the first triangle of every cluster and has to fit
+// num_indices / 3 entries. Returns the cluster count.
+uint64_t mesh_optimize_vertex_cache(uint32_t* indices, uint64_t num_indices, uint64_t num_vertices,
+    uint32_t* clusters);
+// positions is 3 floats every position_stride bytes
+void mesh_optimize_overdraw(uint32_t* indices, uint64_t num_indices, const float* positions, size_t position_stride,
+    uint64_t num_vertices, const uint32_t* clusters, uint64_t num_clusters);
+void mesh_optimize_vertex_fetch(void* vertices, size_t vertex_size, uint64_t num_vertices, uint32_t* indices,
+    uint64_t num_indices);
+
+// Quadric error edge collapse onto existing vertices, so the result indexes
+// the same vertex buffer. Stops at target_index_count or when the next
+// collapse would move the surface by more than target_error (same units as
+// the positions). destination has to fit num_indices and may be indices.
+// result_error gets the largest error it accepted. Returns the index count.
+uint64_t mesh_simplify(uint32_t* destination, const uint32_t* indices, uint64_t num_indices, const float* positions,
+    size_t position_stride, uint64_t num_vertices, uint64_t target_index_count, float target_error,
+    float* result_error);
+
+// Bounds are in the same space as the positions. Seen from p the whole
+// meshlet faces away when dot(center - p, cone_axis) >= cone_cutoff *
+// length(center - p) + radius, cone_cutoff is 1 when that can't happen.
+struct Meshlet
+{
+  uint32_t first_triangle;
+  uint32_t num_triangles;
+  uint32_t num_vertices;
+  float center[3];
+  float radius;
+  float bounds_min[3];
+  float bounds_max[3];
+  float cone_axis[3];
+  float cone_cutoff;
+};
+
+// Most meshlets mesh_build_meshlets can produce for num_indices
+uint64_t mesh_meshlet_bound(uint64_t num_indices);
+// Splits the triangles into meshlets of at most MESHLET_MAX_VERTICES vertices
+// and MESHLET_MAX_TRIANGLES triangles and reorders indices so every meshlet
+// is one contiguous range. Returns the meshlet count.
+uint64_t mesh_build_meshlets(Meshlet* meshlets, uint32_t* indices, uint64_t num_indices, const float* positions,
+    size_t position_stride, uint64_t num_vertices);
@@ -1,13 +1,10 @@
 // #include "model.h"
 
-#include <algorithm>
 #include <glad/gl.h>
-#include <string>
 #include <iostream>
-#include <vector>
-#define TINYOBJLOADER_IMPLEMENTATION
-#include <vendor/tiny_obj_loader.h>
+#include <mutex>
 
+// #include "obj_parser.h"
 // #include "opengl_renderer.h"
 // #include "memory.h"
 // #include "idk_math.h"
@@ -20,27 +17,73 @@ struct Vertex
 
   bool operator==(const Vertex& other) const
   {
-    return position == other.position && tex_coords == other.tex_coords;
+    return position == other.position && normal == other.normal && tex_coords == other.tex_coords;
   }
 };
 
+// What gets uploaded and cached, 16 bytes. The position is unorm16 inside the
+// group bounds, the normal octahedral encoded into the first two 10 bit
+// fields of a 2_10_10_10 word and the texture coordinates are half floats.
+struct PackedVertex
+{
+  uint16_t position[4]; // w is padding
+  uint32_t normal;
+  uint16_t tex_coords[2];
+};
+
 struct Material
 {
   Texture* diffuse_tex;
   Texture* specular_tex;
+  // Normalized, the textures only get acquired on the main thread once the
+  // model is loaded
+  StringView diffuse_path;
+  StringView specular_path;
 };
 
+// Every group has up to MODEL_MAX_LODS index ranges into the same vertices,
+// each roughly half the triangles of the one before
+#define MODEL_MAX_LODS 4
+// Simplification gives up once a level is off by more than this fraction of
+// the group's bounding box diagonal
+#define MODEL_LOD_MAX_ERROR 0.1f
+// Groups with fewer triangles only get the full detail level
+#define MODEL_LOD_MIN_TRIANGLES 64
+
+struct MeshLod
+{
+  uint64_t first_index;
+  uint64_t num_indices;
+  float error; // How far the surface moved from lods[0], in model units
+};
+
+// All faces of one material, whichever OBJ shapes they came from
 struct MeshMaterialGroup
 {
+  // Only while the model gets built, pack_model overwrites them
   Vertex* vertices;
   uint64_t num_vertices;
   uint32_t* indices;
-  uint64_t num_indices;
+  uint64_t num_indices; // Of all lods together
+  MeshLod lods[MODEL_MAX_LODS]; // lods[0] is the full mesh
+  uint32_t num_lods;
   Material materials;
+  int32_t material_id; // -1 if the faces have no material
 
-  VertexArray* vao;
-  VertexBuffer* vbo;
-  IndexBuffer* ibo;
+  PackedVertex* packed_vertices;
+  void* packed_indices;
+  uint32_t index_size; // 2 bytes when the group has at most 65536 vertices
+  // position = position_offset + unorm16 position * position_scale
+  idk_vec3 position_offset;
+  idk_vec3 position_scale;
+
+  // Where the group landed in the shared geometry buffers
+  uint32_t base_vertex;
+  uint64_t index_offset; // In bytes
+
+  // Range of the model's meshlets that split up lods[0]
+  uint64_t first_meshlet;
+  uint64_t num_meshlets;
 };
 
 struct MeshNode
@@ -49,19 +92,363 @@ struct MeshNode
   MeshNode* next;
 };
 
+// Meshlets of every group, struct of arrays so culling only streams through
+// what it tests. Bounds are in model space.
+struct ModelMeshlets
+{
+  uint64_t count;
+  idk_vec4* spheres; // xyz center, w radius
+  idk_vec4* cones; // xyz axis, w cutoff (see Meshlet)
+  idk_vec3* bounds_min;
+  idk_vec3* bounds_max;
+  uint32_t* first_index; // Into the group's lods[0]
+  uint32_t* num_indices;
+};
+
+// Everything draw needs to pick LODs and cull, see make_draw_view
+struct DrawView
+{
+  idk_vec3 camera_position;
+  // Turns size / distance into pixels, projection[1][1] times half the
+  // viewport height
+  float projection_scale;
+  float max_pixel_error;
+  idk_vec4 frustum[6]; // World space planes, xyz points inside
+  bool cull_meshlets;
+};
+
+enum ModelState
+{
+  ModelState_Loading, // The job is still parsing or reading the cache, nothing to draw
+  ModelState_Streaming, // Groups show up in meshes as they get uploaded
+  ModelState_Ready,
+  ModelState_Failed // Stays empty, the error got logged
+};
+
+struct ModelLoad;
+
 struct Model
 {
+  ModelState state;
   MeshNode* meshes; // Head of linked list
+  Material* materials; // Holds a registry reference to each texture
+  uint32_t num_materials;
+  MappedFile cache; // Geometry points into this when loaded from a .cmesh
+  // Summed over all groups, before and after optimize_model
+  VertexCacheStats vertex_cache_before;
+  VertexCacheStats vertex_cache_after;
+  // Range of the shared geometry buffers the groups were uploaded into
+  uint64_t geometry_first_vertex;
+  uint64_t geometry_num_vertices;
+  uint64_t geometry_index_offset; // In bytes
+  uint64_t geometry_index_bytes;
+  ModelMeshlets meshlets;
+  ModelLoad* load; // Until the model is destroyed, 0 for create_model
+  Arena* arena; // Owned by models from create_model_async
 };
 
+#define MODEL_POOL_RESERVE Megabytes(64)
+static Pool* mesh_node_pool = pool_alloc(sizeof(MeshNode), MODEL_POOL_RESERVE, "MeshNode Pool", ArenaTag_Assets);
+static Pool* mesh_group_pool = pool_alloc(sizeof(MeshMaterialGroup), MODEL_POOL_RESERVE, "MeshMaterialGroup Pool",
+    ArenaTag_Assets);
+// NOTE(ricardo): loads run on the job workers, pools aren't thread safe
+static std::mutex mesh_pool_mutex;
 
-void draw(Model* model, const idk_mat4& transform, OpenGLProgramCommon* shader)
+static void* model_pool_push(Pool* pool)
 {
-  MeshNode* mesh_node = model->meshes;
-  while(mesh_node != 0)
+  std::lock_guard<std::mutex> lock(mesh_pool_mutex);
+  return pool_push(pool);
+}
+
+static void model_pool_free(Pool* pool, void* element)
+{
+  std::lock_guard<std::mutex> lock(mesh_pool_mutex);
+  pool_free(pool, element);
+}
+
+#define MODEL_POOL_PUSH(pool, type) (type*)model_pool_push(pool)
+
+// Async Loads
+// The job builds a complete Model of its own (result) that the main thread
+// copies over once the job is done, so draw never sees a half built model.
+// Groups then move from pending to the model's list as they get uploaded.
+struct ModelLoad
+{
+  Model* model;
+  Model* result; // Set by the job
+  Arena* arena;
+  StringView path; // Null terminated
+  JobCounter counter;
+  MeshNode* pending; // Placed in the geometry buffers but not uploaded yet
+  MeshNode** tail; // Where the next uploaded group gets linked
+  ModelLoad* next; // In streaming_models
+};
+
+static ModelLoad* streaming_models;
+
+
+// Shared Geometry
+// Every model is uploaded into one vertex buffer and one index buffer behind
+// a single VAO, groups keep their base vertex and index offset. Ranges are
+// handed out front to back like an arena: destroying the newest model gives
+// its range back, any other hole waits until no model is left. Full buffers
+// are replaced by ones twice the size and the old contents copied on the GPU.
+struct ModelGeometryBuffers
+{
+  VertexArray* vao;
+  VertexBuffer* vbo;
+  IndexBuffer* ibo;
+  uint64_t vertex_capacity; // In vertices
+  uint64_t index_capacity; // In bytes
+  uint64_t num_vertices;
+  uint64_t index_bytes;
+  uint32_t num_models;
+};
+
+static ModelGeometryBuffers model_geometry;
+
+static void model_geometry_reserve(uint64_t num_vertices, uint64_t index_bytes)
+{
+  ModelGeometryBuffers* geometry = &model_geometry;
+  if(geometry->vao == 0)
+    geometry->vao = opengl_create_vertex_array();
+
+  if(geometry->num_vertices + num_vertices > geometry->vertex_capacity)
+  {
+    uint64_t capacity = geometry->vertex_capacity * 2;
+    if(capacity < geometry->num_vertices + num_vertices)
+      capacity = geometry->num_vertices + num_vertices;
+    VertexBuffer* vbo = opengl_create_vertex_buffer(0, capacity * sizeof(PackedVertex));
+    if(geometry->vbo)
+    {
+      opengl_copy_buffer(geometry->vbo->id, vbo->id, geometry->num_vertices * sizeof(PackedVertex));
+      opengl_destroy_vertex_buffer(geometry->vbo);
+    }
+    geometry->vbo = vbo;
+    geometry->vertex_capacity = capacity;
+
+    // The VAO still points at the old buffer
+    int enabled_attribs = 0;
+    int stride = sizeof(PackedVertex);
+    int offset = 0;
+    // Position
+    opengl_add_element_to_layout(DataType::UShort4, true, &enabled_attribs, stride, &offset, geometry->vao,
+        geometry->vbo);
+    // Normals
+    opengl_add_element_to_layout(DataType::UInt1010102, true, &enabled_attribs, stride, &offset, geometry->vao,
+        geometry->vbo);
+    // Texture Coords
+    opengl_add_element_to_layout(DataType::Half2, false, &enabled_attribs, stride, &offset, geometry->vao,
+        geometry->vbo);
+  }
+
+  if(geometry->index_bytes + index_bytes > geometry->index_capacity)
+  {
+    uint64_t capacity = geometry->index_capacity * 2;
+    if(capacity < geometry->index_bytes + index_bytes)
+      capacity = geometry->index_bytes + index_bytes;
+    // NOTE(ricardo): 16 and 32 bit groups share the buffer, the type only
+    // matters per draw
+    IndexBuffer* ibo = opengl_create_index_buffer(0, (unsigned int)(capacity / sizeof(uint32_t)), sizeof(uint32_t));
+    if(geometry->ibo)
+    {
+      opengl_copy_buffer(geometry->ibo->id, ibo->id, geometry->index_bytes);
+      opengl_destroy_index_buffer(geometry->ibo);
+    }
+    geometry->ibo = ibo;
+    geometry->index_capacity = capacity;
+    opengl_set_index_buffer(geometry->vao, geometry->ibo);
+  }
+}
+
+static void model_geometry_free(Model* model)
+{
+  ModelGeometryBuffers* geometry = &model_geometry;
+  geometry->num_models--;
+  if(geometry->num_models == 0)
+  {
+    if(geometry->vao)
+      opengl_destroy_vertex_array(geometry->vao);
+    if(geometry->vbo)
+      opengl_destroy_vertex_buffer(geometry->vbo);
+    if(geometry->ibo)
+      opengl_destroy_index_buffer(geometry->ibo);
+    *geometry = {};
+    return;
+  }
+  if(model->geometry_first_vertex + model->geometry_num_vertices == geometry->num_vertices)
+    geometry->num_vertices = model->geometry_first_vertex;
+  if(model->geometry_index_offset + model->geometry_index_bytes == geometry->index_bytes)
+    geometry->index_bytes = model->geometry_index_offset;
+}
+
+DrawView make_draw_view(idk_vec3 camera_position, const idk_mat4& projection, const idk_mat4& view,
+    float viewport_height, float max_pixel_error)
+{
+  DrawView result = {};
+  result.camera_position = camera_position;
+  result.projection_scale = projection.elements[1][1] * 0.5f * viewport_height;
+  result.max_pixel_error = max_pixel_error;
+  result.cull_meshlets = true;
+  // NOTE(ricardo): Gribb/Hartmann, -w <= x, y, z <= w in clip space turns
+  // into row 3 +- rows 0, 1 and 2 of the view projection matrix
+  idk_mat4 view_projection = idk_mul_mat4(projection, view);
+  for(int plane = 0; plane < 6; plane++)
+  {
+    int row = plane / 2;
+    float sign = plane % 2 ? -1.0f : 1.0f;
+    idk_vec4 equation = {};
+    for(int column = 0; column < 4; column++)
+      equation[column] = view_projection.elements[column][3] + sign * view_projection.elements[column][row];
+    float length = sqrtf(equation.x * equation.x + equation.y * equation.y + equation.z * equation.z);
+    for(int k = 0; k < 4; k++)
+      equation[k] /= length;
+    result.frustum[plane] = equation;
+  }
+  return result;
+}
+
+// NOTE(ricardo): column major, translation in the last column. Culling
+// assumes no shear, the largest column length bounds how much it scales.
+static idk_vec3 transform_vector(const idk_mat4& transform, idk_vec3 vector)
+{
+  idk_vec3 result = {};
+  for(int column = 0; column < 3; column++)
+  {
+    for(int row = 0; row < 3; row++)
+      result[row] += transform.elements[column][row] * vector[column];
+  }
+  return result;
+}
+
+static idk_vec3 transform_point(const idk_mat4& transform, idk_vec3 point)
+{
+  idk_vec3 translation = idk_vec3f(transform.elements[3][0], transform.elements[3][1], transform.elements[3][2]);
+  return translation + transform_vector(transform, point);
+}
+
+static float transform_max_scale(const idk_mat4& transform)
+{
+  float scale = 0.0f;
+  for(int column = 0; column < 3; column++)
+  {
+    idk_vec3 axis = idk_vec3f(transform.elements[column][0], transform.elements[column][1],
+        transform.elements[column][2]);
+    scale = idk_max(scale, idk_vec3_length(axis));
+  }
+  return scale;
+}
+
+static bool sphere_in_frustum(const DrawView* view, idk_vec3 center, float radius)
+{
+  for(int plane = 0; plane < 6; plane++)
+  {
+    const idk_vec4& equation = view->frustum[plane];
+    if(equation.x * center.x + equation.y * center.y + equation.z * center.z + equation.w < -radius)
+      return false;
+  }
+  return true;
+}
+
+// Coarsest level whose error, projected at the group's bounding sphere, stays
+// under view->max_pixel_error. Inside the sphere it's always full detail.
+static MeshLod* select_mesh_lod(MeshMaterialGroup* mesh, const DrawView* view, idk_vec3 center, float radius,
+    float scale)
+{
+  float distance = idk_vec3_length(center - view->camera_position) - radius;
+  if(mesh->num_lods == 1 || distance <= 0.0f)
+    return mesh->lods;
+
+  float pixels_per_unit = view->projection_scale * scale / distance;
+  MeshLod* result = mesh->lods;
+  for(uint32_t i = 1; i < mesh->num_lods; i++)
+  {
+    if(mesh->lods[i].error * pixels_per_unit > view->max_pixel_error)
+      break;
+    result = mesh->lods + i;
+  }
+  return result;
+}
+
+// Index ranges of the group's meshlets that are inside the frustum and don't
+// face away, neighbouring meshlets merge into one range. Returns the count.
+static uint64_t cull_meshlets(ModelMeshlets* meshlets, MeshMaterialGroup* mesh, const idk_mat4& transform,
+    float scale, const DrawView* view, uint64_t* first_indices, GLsizei* counts)
+{
+  uint64_t num_ranges = 0;
+  uint64_t range_end = UINT64_MAX;
+  for(uint64_t i = mesh->first_meshlet; i < mesh->first_meshlet + mesh->num_meshlets; i++)
+  {
+    idk_vec4 sphere = meshlets->spheres[i];
+    idk_vec3 center = transform_point(transform, idk_vec3f(sphere.x, sphere.y, sphere.z));
+    float radius = sphere.w * scale;
+    if(!sphere_in_frustum(view, center, radius))
+      continue;
+    idk_vec4 cone = meshlets->cones[i];
+    if(cone.w < 1.0f)
+    {
+      idk_vec3 axis = idk_normalize_vec3(transform_vector(transform, idk_vec3f(cone.x, cone.y, cone.z)));
+      idk_vec3 to_center = center - view->camera_position;
+      if(idk_dot_vec3(to_center, axis) >= cone.w * idk_vec3_length(to_center) + radius)
+        continue;
+    }
+
+    uint64_t first_index = meshlets->first_index[i];
+    if(first_index == range_end)
+    {
+      counts[num_ranges - 1] += (GLsizei)meshlets->num_indices[i];
+    }
+    else
+    {
+      first_indices[num_ranges] = first_index;
+      counts[num_ranges++] = (GLsizei)meshlets->num_indices[i];
+    }
+    range_end = first_index + meshlets->num_indices[i];
+  }
+  return num_ranges;
+}
+
+uint64_t draw(Model* model, const idk_mat4& transform, OpenGLProgramCommon* shader, const DrawView* view)
+{
+  uint64_t num_triangles = 0;
+  // Nothing uploaded yet, the shared buffers might not even exist
+  if(model->meshes == 0)
+    return 0;
+  float scale = transform_max_scale(transform);
+  glUseProgram(shader->program_id);
+  glBindVertexArray(model_geometry.vao->id);
+  for(MeshNode* mesh_node = model->meshes; mesh_node != 0; mesh_node = mesh_node->next)
   {
     MeshMaterialGroup* mesh = mesh_node->data;
-    glUseProgram(shader->program_id);
+    MeshLod* lod = mesh->lods;
+    if(view)
+    {
+      idk_vec3 local_center = {};
+      for(int axis = 0; axis < 3; axis++)
+        local_center[axis] = mesh->position_offset[axis] + mesh->position_scale[axis] * 0.5f;
+      idk_vec3 center = transform_point(transform, local_center);
+      float radius = idk_vec3_length(mesh->position_scale) * 0.5f * scale;
+      if(!sphere_in_frustum(view, center, radius))
+        continue;
+      lod = select_mesh_lod(mesh, view, center, radius, scale);
+    }
+
+    // Only the full detail level is split into meshlets. The ranges only have
+    // to live until the draw call, they go into this frame's arena.
+    Arena* arena = frame_arena();
+    uint64_t num_ranges = 1;
+    uint64_t* first_indices = &lod->first_index;
+    GLsizei lod_count = (GLsizei)lod->num_indices;
+    GLsizei* counts = &lod_count;
+    if(view && view->cull_meshlets && lod == mesh->lods && mesh->num_meshlets)
+    {
+      first_indices = (uint64_t*)arena_push_no_zero(arena, mesh->num_meshlets * sizeof(uint64_t));
+      counts = (GLsizei*)arena_push_no_zero(arena, mesh->num_meshlets * sizeof(GLsizei));
+      num_ranges = cull_meshlets(&model->meshlets, mesh, transform, scale, view, first_indices, counts);
+    }
+    if(num_ranges == 0)
+      continue;
+
     Texture* diffuse_tex = mesh->materials.diffuse_tex;
     Texture* specular_tex = mesh->materials.specular_tex;
     if(diffuse_tex)
@@ -75,186 +462,1127 @@ void draw(Model* model, const idk_mat4& transform, OpenGLProgramCommon* shader)
       opengl_bind_texture(specular_tex->id, 1);
     }
     glActiveTexture(GL_TEXTURE0);
-    glBindVertexArray(mesh->vao->id);
-    glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, mesh->ibo->id);
-    glDrawElements(GL_TRIANGLES, mesh->num_indices, GL_UNSIGNED_INT, 0);
-    glBindVertexArray(0);
-    glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, 0);
-    glUseProgram(0);
-    mesh_node = mesh_node->next;
+    glUniform3fv(shader->position_offset, 1, mesh->position_offset.elements);
+    glUniform3fv(shader->position_scale, 1, mesh->position_scale.elements);
+    GLenum index_type = mesh->index_size == 2 ? GL_UNSIGNED_SHORT : GL_UNSIGNED_INT;
+    if(num_ranges == 1)
+    {
+      glDrawElementsBaseVertex(GL_TRIANGLES, counts[0], index_type,
+          (const void*)(mesh->index_offset + first_indices[0] * mesh->index_size), (GLint)mesh->base_vertex);
+    }
+    else
+    {
+      const void** offsets = (const void**)arena_push_no_zero(arena, num_ranges * sizeof(void*));
+      GLint* base_vertices = (GLint*)arena_push_no_zero(arena, num_ranges * sizeof(GLint));
+      for(uint64_t i = 0; i < num_ranges; i++)
+      {
+        offsets[i] = (const void*)(mesh->index_offset + first_indices[i] * mesh->index_size);
+        base_vertices[i] = (GLint)mesh->base_vertex;
+      }
+      glMultiDrawElementsBaseVertex(GL_TRIANGLES, counts, index_type, offsets, (GLsizei)num_ranges, base_vertices);
+    }
+    for(uint64_t i = 0; i < num_ranges; i++)
+      num_triangles += counts[i] / 3;
   }
+  glBindVertexArray(0);
+  glUseProgram(0);
+  return num_triangles;
 }
 
-Model* create_model(Arena* arena, const std::string& path)
+// Texture names in .mtl files are relative to the model and may use '\\',
+// the registry normalizes the result
+static StringView model_texture_path(Arena* arena, StringView directory, StringView texname)
 {
-  std::string directory =path.substr(0, path.find_last_of('/'));
+  TempArena scratch = scratch_begin(&arena, 1);
+  StringView path = texname;
+  if(directory.size)
+    path = str_push_fmt(scratch.arena, "%.*s/%.*s", (int)directory.size, directory.data, (int)texname.size,
+        texname.data);
+  StringView result = str_push_normalized_path(arena, path);
+  scratch_end(scratch);
+  return result;
+}
 
-  tinyobj::ObjReaderConfig reader_config;
-  reader_config.mtl_search_path = directory;
-  tinyobj::ObjReader reader;
+static Model* load_model_obj(Arena* arena, StringView path, StringView directory)
+{
+  // NOTE(ricardo): the parsed OBJ is only needed until the groups are built
+  TempArena obj_scratch = scratch_begin(&arena, 1);
+  ObjData obj;
+  if (!obj_parse(obj_scratch.arena, path, directory, &obj))
+  {
+    scratch_end(obj_scratch);
+    return 0;
+  }
+  ObjMaterial* materials = obj.materials;
 
+  Material * all_materials = (Material*)arena_push(arena, obj.num_materials * sizeof(Material));
+  for (size_t i = 0; i < obj.num_materials; i++)
+  {
+    if (materials[i].diffuse_texname.size)
+      all_materials[i].diffuse_path = model_texture_path(arena, directory, materials[i].diffuse_texname);
+    if (materials[i].specular_texname.size)
+      all_materials[i].specular_path = model_texture_path(arena, directory, materials[i].specular_texname);
+    else if (materials[i].bump_texname.size)
+      all_materials[i].specular_path = model_texture_path(arena, directory, materials[i].bump_texname);
+  }
+
+  Model* model = (Model*)arena_push(arena,sizeof(Model));
+  model->materials = all_materials;
+  model->num_materials = obj.num_materials;
+
+  // NOTE(ricardo): shapes and material changes inside them don't matter for
+  // drawing, bucket the faces of every shape by material so each material
+  // ends up as exactly one group (one draw). Bucket 0 is the faces without
+  // one, the rest is material_id + 1. Faces keep their order in the file.
+  TempArena scratch = scratch_begin(&arena, 1);
+  uint32_t num_buckets = obj.num_materials + 1;
+  uint64_t* bucket_offsets = (uint64_t*)arena_push(scratch.arena, (num_buckets + 1) * sizeof(uint64_t));
+  uint64_t num_faces = 0;
+  for (size_t s = 0; s < obj.num_shapes; s++)
+  {
+    ObjShape* shape = obj.shapes + s;
+    for (size_t f = 0; f < shape->num_faces; f++)
+      bucket_offsets[shape->material_ids[f] + 2]++;
+    num_faces += shape->num_faces;
+  }
+  for (uint32_t b = 0; b < num_buckets; b++)
+    bucket_offsets[b + 1] += bucket_offsets[b];
+  // NOTE(ricardo): the parser triangulates, always 3 corners per face
+  ObjIndex** faces = (ObjIndex**)arena_push_no_zero(scratch.arena, num_faces * sizeof(ObjIndex*));
+  for (size_t s = 0; s < obj.num_shapes; s++)
+  {
+    ObjShape* shape = obj.shapes + s;
+    for (size_t f = 0; f < shape->num_faces; f++)
+      faces[bucket_offsets[shape->material_ids[f] + 1]++] = shape->indices + f * 3;
+  }
+  // Every offset got moved to the end of its bucket, so bucket b now starts
+  // at offsets[b - 1]
 
-  if (!reader.ParseFromFile(path, reader_config))
+  MeshNode** next = &model->meshes;
+  uint64_t total_vertices = 0;
+  uint64_t total_corners = 0;
+  for (uint32_t b = 0; b < num_buckets; b++)
   {
-    if (!reader.Error().empty())
+    uint64_t first_face = b == 0 ? 0 : bucket_offsets[b - 1];
+    uint64_t bucket_faces = bucket_offsets[b] - first_face;
+    if (bucket_faces == 0)
+      continue;
+
+    MeshNode* node = MODEL_POOL_PUSH(mesh_node_pool, MeshNode);
+    node->data = MODEL_POOL_PUSH(mesh_group_pool, MeshMaterialGroup);
+    *next = node;
+    next = &node->next;
+    MeshMaterialGroup* mesh = node->data;
+    mesh->material_id = (int32_t)b - 1;
+    if (mesh->material_id >= 0)
+      mesh->materials = all_materials[mesh->material_id];
+
+    // NOTE(ricardo): every vertex and index gets written below, no need to zero.
+    // Vertices go last so the unused tail can be popped once they are welded.
+    size_t num_corners = bucket_faces * 3;
+    mesh->indices = (uint32_t*)arena_push_no_zero(arena, sizeof(unsigned int) * num_corners);
+    mesh->vertices = (Vertex*)arena_push_no_zero(arena, sizeof(Vertex) * num_corners);
+
+    // Face corners that share position, normal and uv become one vertex
+    TempArena weld_scratch = scratch_begin(&arena, 1);
+    HashMap<Vertex, uint32_t> welded = hash_map_init<Vertex, uint32_t>(weld_scratch.arena, num_corners);
+    for (uint64_t f = 0; f < bucket_faces; f++)
     {
-      printf("TinyObjReader: %s", reader.Error().c_str());
+      ObjIndex* face = faces[first_face + f];
+      for (size_t v = 0; v < 3; v++)
+      {
+        ObjIndex index = face[v];
+        Vertex vertex{};
+
+        vertex.position = {{obj.positions[3 * index.vertex_index + 0],
+          obj.positions[3 * index.vertex_index + 1],
+          obj.positions[3 * index.vertex_index + 2]}};
+
+        // Check if it has texture coordinates
+        if (index.texcoord_index >= 0)
+        {
+          vertex.tex_coords = {obj.texcoords[2 * index.texcoord_index + 0],
+            1.0f - obj.texcoords[2 * index.texcoord_index + 1]};
+        }
+
+        // Check if it has normals
+        if (index.normal_index >= 0)
+        {
+          vertex.normal = {{obj.normals[3 * index.normal_index + 0],
+            obj.normals[3 * index.normal_index + 1],
+            obj.normals[3 * index.normal_index + 2]}};
+        }
+
+        // NOTE(ricardo): + 0.0f turns -0.0f into 0.0f, the map hashes the bytes
+        // but == compares values, so both zeros have to hash the same
+        for (int i = 0; i < 3; i++)
+        {
+          vertex.position[i] += 0.0f;
+          vertex.normal[i] += 0.0f;
+        }
+        vertex.tex_coords.x += 0.0f;
+        vertex.tex_coords.y += 0.0f;
+
+        uint32_t vertex_index;
+        uint32_t* welded_index = hash_map_get(&welded, vertex);
+        if(welded_index)
+        {
+          vertex_index = *welded_index;
+        }
+        else
+        {
+          vertex_index = (uint32_t)mesh->num_vertices++;
+          mesh->vertices[vertex_index] = vertex;
+          hash_map_put(&welded, vertex, vertex_index);
+        }
+        mesh->indices[mesh->num_indices++] = vertex_index;
+        total_corners++;
+      }
+    }
+    scratch_end(weld_scratch);
+
+    // Give back the vertex slots welding didn't need
+    Vertex* vertices_end = mesh->vertices + mesh->num_vertices;
+    total_vertices += mesh->num_vertices;
+    arena_pop_to(arena, (unsigned char*)vertices_end - arena->mem_base);
+  }
+  scratch_end(scratch);
+  scratch_end(obj_scratch);
+  printf("Loaded %.*s: %llu vertices (%llu before welding), %llu shapes into one group per material\n",
+      (int)path.size, path.data, (unsigned long long)total_vertices, (unsigned long long)total_corners,
+      (unsigned long long)obj.num_shapes);
+  return model;
+}
+
+struct MeshOptimizeJob
+{
+  MeshMaterialGroup* mesh;
+  uint64_t index_capacity;
+  Meshlet* meshlets; // Room for mesh_meshlet_bound
+  uint64_t num_meshlets;
+  VertexCacheStats before;
+  VertexCacheStats after;
+};
+
+// Each level simplifies the one before it and goes right after it in the
+// index buffer. Levels that barely got smaller aren't worth their memory.
+static void build_mesh_lods(MeshMaterialGroup* mesh, uint64_t index_capacity)
+{
+  mesh->lods[0].first_index = 0;
+  mesh->lods[0].num_indices = mesh->num_indices;
+  mesh->lods[0].error = 0.0f;
+  mesh->num_lods = 1;
+  if(mesh->num_indices < MODEL_LOD_MIN_TRIANGLES * 3)
+    return;
+
+  idk_vec3 bounds_min = idk_vec3fv(IDK_F32_MAX);
+  idk_vec3 bounds_max = idk_vec3fv(-IDK_F32_MAX);
+  for(uint64_t i = 0; i < mesh->num_vertices; i++)
+  {
+    for(int axis = 0; axis < 3; axis++)
+    {
+      bounds_min[axis] = idk_min(bounds_min[axis], mesh->vertices[i].position[axis]);
+      bounds_max[axis] = idk_max(bounds_max[axis], mesh->vertices[i].position[axis]);
     }
-    exit(1);
+  }
+  float max_error = idk_vec3_length(bounds_max - bounds_min) * MODEL_LOD_MAX_ERROR;
+
+  while(mesh->num_lods < MODEL_MAX_LODS)
+  {
+    MeshLod* previous = mesh->lods + mesh->num_lods - 1;
+    uint64_t first_index = previous->first_index + previous->num_indices;
+    if(index_capacity - first_index < previous->num_indices || previous->error >= max_error)
+      break;
+
+    uint32_t* source = mesh->indices + previous->first_index;
+    uint32_t* destination = mesh->indices + first_index;
+    uint64_t target_index_count = previous->num_indices / 6 * 3;
+    float error = 0.0f;
+    uint64_t num_indices = mesh_simplify(destination, source, previous->num_indices, &mesh->vertices->position.x,
+        sizeof(Vertex), mesh->num_vertices, target_index_count, max_error - previous->error, &error);
+    if(num_indices == 0 || num_indices * 4 > previous->num_indices * 3)
+      break;
+
+    TempArena scratch = scratch_begin(0, 0);
+    uint32_t* clusters = (uint32_t*)arena_push_no_zero(scratch.arena, num_indices / 3 * sizeof(uint32_t));
+    mesh_optimize_vertex_cache(destination, num_indices, mesh->num_vertices, clusters);
+    scratch_end(scratch);
+
+    MeshLod* lod = mesh->lods + mesh->num_lods++;
+    lod->first_index = first_index;
+    lod->num_indices = num_indices;
+    // Errors of successive levels can add up, so this stays an upper bound
+    lod->error = previous->error + error;
+  }
+  MeshLod* last = mesh->lods + mesh->num_lods - 1;
+  mesh->num_indices = last->first_index + last->num_indices;
+}
+
+static void mesh_optimize_job(void* job_data)
+{
+  MeshOptimizeJob* job = (MeshOptimizeJob*)job_data;
+  MeshMaterialGroup* mesh = job->mesh;
+  job->before = mesh_analyze_vertex_cache(mesh->indices, mesh->num_indices, mesh->num_vertices,
+      MESH_OPTIMIZE_CACHE_SIZE);
+
+  // NOTE(ricardo): meshes with barely any sharing (soups, tiny groups) can come
+  // out of the cluster sort worse than they went in, keep the old order then
+  TempArena scratch = scratch_begin(0, 0);
+  uint64_t indices_size = mesh->num_indices * sizeof(uint32_t);
+  uint32_t* original = (uint32_t*)arena_push_no_zero(scratch.arena, indices_size);
+  memcpy(original, mesh->indices, indices_size);
+  uint32_t* clusters = (uint32_t*)arena_push_no_zero(scratch.arena, mesh->num_indices / 3 * sizeof(uint32_t));
+  uint64_t num_clusters = mesh_optimize_vertex_cache(mesh->indices, mesh->num_indices, mesh->num_vertices, clusters);
+  mesh_optimize_overdraw(mesh->indices, mesh->num_indices, &mesh->vertices->position.x, sizeof(Vertex),
+      mesh->num_vertices, clusters, num_clusters);
+  VertexCacheStats optimized = mesh_analyze_vertex_cache(mesh->indices, mesh->num_indices, mesh->num_vertices,
+      MESH_OPTIMIZE_CACHE_SIZE);
+  if(optimized.misses > job->before.misses)
+    memcpy(mesh->indices, original, indices_size);
+  scratch_end(scratch);
+
+  // Every meshlet becomes one contiguous range of lods[0], the coarser
+  // levels are built from that order
+  job->num_meshlets = mesh_build_meshlets(job->meshlets, mesh->indices, mesh->num_indices,
+      &mesh->vertices->position.x, sizeof(Vertex), mesh->num_vertices);
+  build_mesh_lods(mesh, job->index_capacity);
+  // Fetch order follows the full detail level, the others use a subset of it
+  mesh_optimize_vertex_fetch(mesh->vertices, sizeof(Vertex), mesh->num_vertices, mesh->indices, mesh->num_indices);
+
+  job->after = mesh_analyze_vertex_cache(mesh->indices, mesh->lods[0].num_indices, mesh->num_vertices,
+      MESH_OPTIMIZE_CACHE_SIZE);
+}
+
+// Reorders every group for the vertex cache, overdraw and vertex fetch and
+// builds its meshlets and LODs, one job per group. Only runs on freshly parsed models, the
+// .cmesh stores the result.
+static void optimize_model(Arena* arena, Model* model)
+{
+  // LODs go after the full mesh, give every group room for twice its indices
+  // up front so the jobs don't have to allocate from the model arena
+  for(MeshNode* it = model->meshes; it != 0; it = it->next)
+  {
+    MeshMaterialGroup* mesh = it->data;
+    uint32_t* indices = (uint32_t*)arena_push_no_zero(arena, mesh->num_indices * 2 * sizeof(uint32_t));
+    memcpy(indices, mesh->indices, mesh->num_indices * sizeof(uint32_t));
+    mesh->indices = indices;
+  }
+
+  TempArena scratch = scratch_begin(&arena, 1);
+  uint64_t num_groups = 0;
+  for(MeshNode* it = model->meshes; it != 0; it = it->next)
+    num_groups++;
+
+  MeshOptimizeJob* jobs = (MeshOptimizeJob*)arena_push(scratch.arena, num_groups * sizeof(MeshOptimizeJob));
+  JobCounter counter = {};
+  uint64_t job_index = 0;
+  for(MeshNode* it = model->meshes; it != 0; it = it->next)
+  {
+    jobs[job_index].mesh = it->data;
+    jobs[job_index].index_capacity = it->data->num_indices * 2;
+    jobs[job_index].meshlets = (Meshlet*)arena_push_no_zero(scratch.arena,
+        mesh_meshlet_bound(it->data->num_indices) * sizeof(Meshlet));
+    job_push(mesh_optimize_job, jobs + job_index, &counter);
+    job_index++;
+  }
+  job_wait(&counter);
+
+  model->vertex_cache_before = {};
+  model->vertex_cache_after = {};
+  for(uint64_t i = 0; i < num_groups; i++)
+  {
+    model->vertex_cache_before.misses += jobs[i].before.misses;
+    model->vertex_cache_before.num_triangles += jobs[i].before.num_triangles;
+    model->vertex_cache_before.num_vertices += jobs[i].before.num_vertices;
+    model->vertex_cache_after.misses += jobs[i].after.misses;
+    model->vertex_cache_after.num_triangles += jobs[i].after.num_triangles;
+    model->vertex_cache_after.num_vertices += jobs[i].after.num_vertices;
   }
 
-  if (!reader.Warning().empty())
+  ModelMeshlets* meshlets = &model->meshlets;
+  meshlets->count = 0;
+  for(uint64_t i = 0; i < num_groups; i++)
+    meshlets->count += jobs[i].num_meshlets;
+  meshlets->spheres = (idk_vec4*)arena_push_no_zero(arena, meshlets->count * sizeof(idk_vec4));
+  meshlets->cones = (idk_vec4*)arena_push_no_zero(arena, meshlets->count * sizeof(idk_vec4));
+  meshlets->bounds_min = (idk_vec3*)arena_push_no_zero(arena, meshlets->count * sizeof(idk_vec3));
+  meshlets->bounds_max = (idk_vec3*)arena_push_no_zero(arena, meshlets->count * sizeof(idk_vec3));
+  meshlets->first_index = (uint32_t*)arena_push_no_zero(arena, meshlets->count * sizeof(uint32_t));
+  meshlets->num_indices = (uint32_t*)arena_push_no_zero(arena, meshlets->count * sizeof(uint32_t));
+  uint64_t meshlet_index = 0;
+  for(uint64_t i = 0; i < num_groups; i++)
   {
-    printf("TinyObjReader: %s", reader.Warning().c_str());
+    jobs[i].mesh->first_meshlet = meshlet_index;
+    jobs[i].mesh->num_meshlets = jobs[i].num_meshlets;
+    for(uint64_t j = 0; j < jobs[i].num_meshlets; j++, meshlet_index++)
+    {
+      Meshlet* meshlet = jobs[i].meshlets + j;
+      meshlets->spheres[meshlet_index] = {{meshlet->center[0], meshlet->center[1], meshlet->center[2],
+        meshlet->radius}};
+      meshlets->cones[meshlet_index] = {{meshlet->cone_axis[0], meshlet->cone_axis[1], meshlet->cone_axis[2],
+        meshlet->cone_cutoff}};
+      memcpy(meshlets->bounds_min[meshlet_index].elements, meshlet->bounds_min, sizeof(meshlet->bounds_min));
+      memcpy(meshlets->bounds_max[meshlet_index].elements, meshlet->bounds_max, sizeof(meshlet->bounds_max));
+      meshlets->first_index[meshlet_index] = meshlet->first_triangle * 3;
+      meshlets->num_indices[meshlet_index] = meshlet->num_triangles * 3;
+    }
   }
+  scratch_end(scratch);
+}
 
-  const tinyobj::attrib_t& attrib = reader.GetAttrib();
-  const std::vector<tinyobj::shape_t>& shapes = reader.GetShapes();
-  const std::vector<tinyobj::material_t>& materials = reader.GetMaterials();
+// Round to nearest even, overflow becomes infinity
+static uint16_t float_to_half(float value)
+{
+  uint32_t bits;
+  memcpy(&bits, &value, sizeof(bits));
+  uint32_t sign = (bits >> 16) & 0x8000;
+  uint32_t magnitude = bits & 0x7FFFFFFF;
+  if(magnitude > 0x7F800000)
+    return (uint16_t)(sign | 0x7E00); // NaN
+  if(magnitude >= 0x477FF000)
+    return (uint16_t)(sign | 0x7C00); // Rounds past 65504
+  if(magnitude < 0x38800000)
+  {
+    // NOTE(ricardo): subnormal, the scale by 2^24 is exact and lrintf rounds
+    // to nearest even
+    float scaled;
+    memcpy(&scaled, &magnitude, sizeof(scaled));
+    return (uint16_t)(sign | (uint32_t)lrintf(scaled * 16777216.0f));
+  }
+  uint32_t half = (magnitude - 0x38000000) >> 13; // Rebias the exponent from 127 to 15
+  uint32_t rest = magnitude & 0x1FFF;
+  if(rest > 0x1000 || (rest == 0x1000 && (half & 1)))
+    half++;
+  return (uint16_t)(sign | half);
+}
 
-  Arena* temp_arena = arena_alloc(Megabytes(1));
-  Material * all_materials = (Material*)arena_push(temp_arena, materials.size() * sizeof(Material));
-  // Load all textures
-  for (size_t i = 0; i < materials.size(); i++)
+// Projects onto the octahedron |x| + |y| + |z| = 1 and folds the lower half
+// over the diagonals, 10 bits unorm per axis. A zero normal becomes +z.
+static uint32_t pack_normal_octahedral(idk_vec3 normal)
+{
+  float length = fabsf(normal.x) + fabsf(normal.y) + fabsf(normal.z);
+  float x = 0.0f;
+  float y = 0.0f;
+  if(length > 0.0f)
   {
-    if (!materials[i].diffuse_texname.empty())
+    x = normal.x / length;
+    y = normal.y / length;
+    if(normal.z < 0.0f)
     {
-      // TODO(ricardo): put this into a function
-      std::string diffuse_path(materials[i].diffuse_texname);
-      std::replace(diffuse_path.begin(), diffuse_path.end(), '\\', '/');
-      std::string diffuse_path_final = directory + "/" + diffuse_path;
-      Texture* texture = opengl_create_texture(arena, diffuse_path_final.c_str(), diffuse);
-      (all_materials+i)->diffuse_tex = texture;
+      float folded_x = (1.0f - fabsf(y)) * (x >= 0.0f ? 1.0f : -1.0f);
+      float folded_y = (1.0f - fabsf(x)) * (y >= 0.0f ? 1.0f : -1.0f);
+      x = folded_x;
+      y = folded_y;
     }
-    if (!materials[i].specular_texname.empty())
+  }
+  uint32_t packed_x = (uint32_t)(idk_clamp(x * 0.5f + 0.5f, 0.0f, 1.0f) * 1023.0f + 0.5f);
+  uint32_t packed_y = (uint32_t)(idk_clamp(y * 0.5f + 0.5f, 0.0f, 1.0f) * 1023.0f + 0.5f);
+  return packed_x | (packed_y << 10);
+}
+
+// Quantizes a group into the upload format, in place. PackedVertex is half
+// a Vertex and 16 bit indices half of 32 bit ones, so walking front to back
+// only ever overwrites elements that were already read.
+static void pack_mesh_group(MeshMaterialGroup* mesh)
+{
+  idk_vec3 bounds_min = idk_vec3fv(IDK_F32_MAX);
+  idk_vec3 bounds_max = idk_vec3fv(-IDK_F32_MAX);
+  for(uint64_t i = 0; i < mesh->num_vertices; i++)
+  {
+    for(int axis = 0; axis < 3; axis++)
     {
-      std::string specular_path(materials[i].specular_texname);
-      std::replace(specular_path.begin(), specular_path.end(), '\\', '/');
-      std::string specular_path_final = directory + "/" + specular_path;
-      Texture* texture = opengl_create_texture(arena, specular_path_final.c_str(), specular);
-      (all_materials+i)->specular_tex = texture;
+      bounds_min[axis] = idk_min(bounds_min[axis], mesh->vertices[i].position[axis]);
+      bounds_max[axis] = idk_max(bounds_max[axis], mesh->vertices[i].position[axis]);
     }
-    else if (!materials[i].bump_texname.empty())
+  }
+  idk_vec3 inverse_scale = {};
+  for(int axis = 0; axis < 3; axis++)
+  {
+    if(mesh->num_vertices == 0)
+      bounds_min[axis] = bounds_max[axis] = 0.0f;
+    mesh->position_offset[axis] = bounds_min[axis];
+    mesh->position_scale[axis] = bounds_max[axis] - bounds_min[axis];
+    if(mesh->position_scale[axis] > 0.0f)
+      inverse_scale[axis] = 1.0f / mesh->position_scale[axis];
+  }
+
+  PackedVertex* packed_vertices = (PackedVertex*)mesh->vertices;
+  for(uint64_t i = 0; i < mesh->num_vertices; i++)
+  {
+    Vertex vertex = mesh->vertices[i];
+    PackedVertex packed = {};
+    for(int axis = 0; axis < 3; axis++)
     {
-      std::string bump_path(materials[i].bump_texname);
-      std::replace(bump_path.begin(), bump_path.end(), '\\', '/');
-      std::string bump_path_final = directory + "/" + bump_path;
-      Texture* texture = opengl_create_texture(arena, bump_path_final.c_str(), specular);
-      (all_materials+i)->specular_tex = texture;
+      float unorm = (vertex.position[axis] - bounds_min[axis]) * inverse_scale[axis];
+      packed.position[axis] = (uint16_t)(idk_clamp(unorm, 0.0f, 1.0f) * 65535.0f + 0.5f);
     }
+    packed.normal = pack_normal_octahedral(vertex.normal);
+    packed.tex_coords[0] = float_to_half(vertex.tex_coords.x);
+    packed.tex_coords[1] = float_to_half(vertex.tex_coords.y);
+    packed_vertices[i] = packed;
   }
 
-  Model* model = (Model*)arena_push(arena,sizeof(Model));
-  model->meshes = (MeshNode*)arena_push(arena, sizeof(MeshNode));
-  // Head
-  MeshNode* mesh = model->meshes;
+  mesh->index_size = mesh->num_vertices <= 65536 ? 2 : 4;
+  if(mesh->index_size == 2)
+  {
+    uint16_t* packed_indices = (uint16_t*)mesh->indices;
+    for(uint64_t i = 0; i < mesh->num_indices; i++)
+      packed_indices[i] = (uint16_t)mesh->indices[i];
+  }
+  mesh->packed_vertices = packed_vertices;
+  mesh->packed_indices = mesh->indices;
+  mesh->vertices = 0;
+  mesh->indices = 0;
+}
+
+static void pack_model(Model* model)
+{
+  for(MeshNode* it = model->meshes; it != 0; it = it->next)
+    pack_mesh_group(it->data);
+}
 
-  uint32_t mesh_index = 0;
-  for (size_t s = 0; s < shapes.size(); s++)
+// Reserves the range of the shared buffers for every group in groups, the
+// uploads happen one group at a time in upload_mesh_group
+static void place_model_geometry(Model* model, MeshNode* groups)
+{
+  // Lay the groups out after everything already uploaded, index ranges stay
+  // 4 byte aligned so 16 and 32 bit groups can follow each other
+  uint64_t num_vertices = 0;
+  uint64_t index_bytes = 0;
+  for(MeshNode* it = groups; it != 0; it = it->next)
   {
-    size_t index_offset = 0;
-    int previous_face_material_id = -1;
+    num_vertices += it->data->num_vertices;
+    index_bytes = align_forward(index_bytes, sizeof(uint32_t)) + it->data->num_indices * it->data->index_size;
+  }
+  index_bytes = align_forward(index_bytes, sizeof(uint32_t));
+  model_geometry_reserve(num_vertices, index_bytes);
 
-    size_t num_faces = shapes[s].mesh.num_face_vertices.size();
-    // Create new linked list node
-    if(s != 0){
-      mesh->next = (MeshNode*)arena_push(arena, sizeof(MeshNode));
-      mesh = mesh->next;
+  ModelGeometryBuffers* geometry = &model_geometry;
+  model->geometry_first_vertex = geometry->num_vertices;
+  model->geometry_num_vertices = num_vertices;
+  model->geometry_index_offset = geometry->index_bytes;
+  model->geometry_index_bytes = index_bytes;
+  geometry->num_models++;
+
+  uint64_t vertex = model->geometry_first_vertex;
+  uint64_t index_offset = model->geometry_index_offset;
+  for(MeshNode* it = groups; it != 0; it = it->next)
+  {
+    MeshMaterialGroup* mesh = it->data;
+    mesh->base_vertex = (uint32_t)vertex;
+    mesh->index_offset = index_offset;
+    vertex += mesh->num_vertices;
+    index_offset = align_forward(index_offset + mesh->num_indices * mesh->index_size, sizeof(uint32_t));
+  }
+  geometry->num_vertices += num_vertices;
+  geometry->index_bytes += index_bytes;
+}
+
+// NOTE(ricardo): always into the current buffers, growing them copies the
+// whole range including the groups that aren't uploaded yet
+static void upload_mesh_group(MeshMaterialGroup* mesh)
+{
+  ModelGeometryBuffers* geometry = &model_geometry;
+  uint64_t mesh_index_bytes = mesh->num_indices * mesh->index_size;
+  if(mesh->num_vertices)
+    opengl_upload_vertex_buffer(geometry->vbo, mesh->base_vertex * sizeof(PackedVertex), mesh->packed_vertices,
+        mesh->num_vertices * sizeof(PackedVertex));
+  if(mesh_index_bytes)
+    opengl_upload_index_buffer(geometry->ibo, mesh->index_offset, mesh->packed_indices, mesh_index_bytes);
+}
+
+
+// Binary Mesh Cache (.cmesh)
+// Header, material table, group table, texture names, the vertex and index
+// blob of every group (16 byte aligned) exactly as they get uploaded and then
+// the meshlet arrays.
+// Bump CMESH_VERSION whenever PackedVertex or the processing in create_model changes.
+#define CMESH_MAGIC 0x48534D43 // "CMSH"
+#define CMESH_VERSION 7
+
+struct CMeshHeader
+{
+  uint32_t magic;
+  uint32_t version;
+  uint32_t vertex_size;
+  uint32_t num_materials;
+  uint64_t num_groups;
+  uint64_t source_size;
+  uint64_t source_modified_time;
+  uint64_t vertex_cache_misses_before;
+  uint64_t vertex_cache_misses_after;
+  uint64_t num_meshlets;
+  uint64_t meshlet_offset;
+};
+
+// Texture names are relative to the model directory, size 0 means no texture
+struct CMeshMaterial
+{
+  uint64_t diffuse_name_offset;
+  uint64_t diffuse_name_size;
+  uint64_t specular_name_offset;
+  uint64_t specular_name_size;
+};
+
+struct CMeshGroup
+{
+  int64_t material_id;
+  uint64_t num_vertices;
+  uint64_t num_indices;
+  uint64_t vertex_offset;
+  uint64_t index_offset;
+  uint32_t index_size;
+  float position_offset[3];
+  float position_scale[3];
+  uint32_t num_lods;
+  // The levels follow each other in the index blob
+  uint64_t lod_num_indices[MODEL_MAX_LODS];
+  float lod_error[MODEL_MAX_LODS];
+  uint64_t first_meshlet;
+  uint64_t num_meshlets;
+};
+
+// Every ModelMeshlets array in order, each one 16 byte aligned
+#define CMESH_MESHLET_ARRAYS 6
+static const uint64_t cmesh_meshlet_element_sizes[CMESH_MESHLET_ARRAYS] = {
+  sizeof(idk_vec4), sizeof(idk_vec4), sizeof(idk_vec3), sizeof(idk_vec3), sizeof(uint32_t), sizeof(uint32_t)
+};
+
+static uint64_t cmesh_meshlet_layout(uint64_t offset, uint64_t count, uint64_t* array_offsets)
+{
+  for(int i = 0; i < CMESH_MESHLET_ARRAYS; i++)
+  {
+    offset = align_forward(offset, 16);
+    array_offsets[i] = offset;
+    offset += count * cmesh_meshlet_element_sizes[i];
+  }
+  return offset;
+}
+
+static bool cmesh_range_valid(MappedFile* file, uint64_t offset, uint64_t size)
+{
+  return offset <= file->size && size <= file->size - offset;
+}
+
+// NOTE(ricardo): material paths are the normalized "<directory>/<texname>", so
+// a texname like "../shared/a.png" no longer starts with the directory. Walk
+// back up from the first segment that differs. directory has to be normalized.
+static uint64_t cmesh_append_texture_name(StringBuilder* names, StringView name, StringView directory)
+{
+  if(name.size == 0)
+    return 0;
+  uint64_t start = names->chars.count;
+
+  uint64_t common = 0; // Start of the first segment that differs
+  for(uint64_t i = 0; i < name.size; i++)
+  {
+    bool directory_ended = i == directory.size;
+    if(name.data[i] == '/' && (directory_ended || directory.data[i] == '/'))
+      common = i + 1;
+    if(directory_ended || directory.data[i] != name.data[i])
+      break;
+  }
+  if(common < directory.size)
+  {
+    str_builder_append(names, str_view("../"));
+    for(uint64_t i = common; i < directory.size; i++)
+    {
+      if(directory.data[i] == '/')
+        str_builder_append(names, str_view("../"));
     }
-    mesh->data = (MeshMaterialGroup*)arena_push(arena, sizeof(MeshMaterialGroup));
+  }
+  str_builder_append(names, str_view(name.data + common, name.size - common));
+  return names->chars.count - start;
+}
+
+static Model* load_model_cache(Arena* arena, StringView directory, StringView cache_path, FileInfo source_info)
+{
+  MappedFile file = map_entire_file(cache_path.data);
+  if(file.data == 0)
+    return 0;
+
+  unsigned char* base = (unsigned char*)file.data;
+  CMeshHeader* header = (CMeshHeader*)base;
+  bool valid = file.size >= sizeof(CMeshHeader) && header->magic == CMESH_MAGIC &&
+    header->version == CMESH_VERSION && header->vertex_size == sizeof(PackedVertex);
+  // A cache without its source is fine, a stale one is not
+  if(valid && source_info.exists)
+  {
+    valid = header->source_size == source_info.size &&
+      header->source_modified_time == source_info.modified_time;
+  }
+  uint64_t tables_size = (uint64_t)header->num_materials * sizeof(CMeshMaterial);
+  valid = valid && header->num_groups <= file.size / sizeof(CMeshGroup) &&
+    cmesh_range_valid(&file, sizeof(CMeshHeader), tables_size + header->num_groups * sizeof(CMeshGroup));
+  uint64_t meshlet_arrays[CMESH_MESHLET_ARRAYS];
+  valid = valid && header->meshlet_offset <= file.size && header->num_meshlets <= file.size / sizeof(uint32_t) &&
+    cmesh_meshlet_layout(header->meshlet_offset, header->num_meshlets, meshlet_arrays) <= file.size;
+  if(!valid)
+  {
+    unmap_file(&file);
+    return 0;
+  }
+  uint32_t* meshlet_first_index = (uint32_t*)(base + meshlet_arrays[4]);
+  uint32_t* meshlet_num_indices = (uint32_t*)(base + meshlet_arrays[5]);
 
-    // NOTE(ricardo): we assume that the mesh is triangulated (only 3 vertices per face)
-    mesh->data->vertices = (Vertex*)arena_push(arena, sizeof(Vertex) * num_faces*3);
-    mesh->data->indices = (uint32_t*)arena_push(arena, sizeof(unsigned int) * num_faces*3);
-    uint32_t indice = 0;
-    for (size_t f = 0; f < num_faces; f++)
+  CMeshMaterial* cache_materials = (CMeshMaterial*)(base + sizeof(CMeshHeader));
+  CMeshGroup* cache_groups = (CMeshGroup*)(base + sizeof(CMeshHeader) + tables_size);
+  for(uint64_t i = 0; i < header->num_groups; i++)
+  {
+    CMeshGroup* group = cache_groups + i;
+    uint64_t lod_indices = 0;
+    for(uint32_t lod = 0; lod < MODEL_MAX_LODS && lod < group->num_lods; lod++)
+      lod_indices += group->lod_num_indices[lod];
+    if((group->index_size != 2 && group->index_size != 4) ||
+        group->num_lods == 0 || group->num_lods > MODEL_MAX_LODS || lod_indices != group->num_indices ||
+        !cmesh_range_valid(&file, group->vertex_offset, group->num_vertices * sizeof(PackedVertex)) ||
+        !cmesh_range_valid(&file, group->index_offset, group->num_indices * group->index_size) ||
+        group->material_id >= (int64_t)header->num_materials ||
+        group->num_meshlets > header->num_meshlets ||
+        group->first_meshlet > header->num_meshlets - group->num_meshlets)
+    {
+      unmap_file(&file);
+      return 0;
+    }
+    for(uint64_t j = group->first_meshlet; j < group->first_meshlet + group->num_meshlets; j++)
     {
-      size_t fv = size_t(shapes[s].mesh.num_face_vertices[f]);
-      for(size_t v = 0; v < fv; v++)
+      if((uint64_t)meshlet_first_index[j] + meshlet_num_indices[j] > group->lod_num_indices[0])
       {
-        tinyobj::index_t index = shapes[s].mesh.indices[index_offset + v];
-        Vertex vertex{};
+        unmap_file(&file);
+        return 0;
+      }
+    }
+  }
+  for(uint32_t i = 0; i < header->num_materials; i++)
+  {
+    CMeshMaterial* material = cache_materials + i;
+    if(!cmesh_range_valid(&file, material->diffuse_name_offset, material->diffuse_name_size) ||
+        !cmesh_range_valid(&file, material->specular_name_offset, material->specular_name_size))
+    {
+      unmap_file(&file);
+      return 0;
+    }
+  }
 
-        vertex.position = {{attrib.vertices[3 * index.vertex_index + 0],
-          attrib.vertices[3 * index.vertex_index + 1],
-          attrib.vertices[3 * index.vertex_index + 2]}};
+  Model* model = (Model*)arena_push(arena, sizeof(Model));
+  model->cache = file;
+  model->num_materials = header->num_materials;
+  model->materials = (Material*)arena_push(arena, header->num_materials * sizeof(Material));
+  for(uint32_t i = 0; i < header->num_materials; i++)
+  {
+    CMeshMaterial* material = cache_materials + i;
+    if(material->diffuse_name_size)
+    {
+      StringView name = str_view((char*)base + material->diffuse_name_offset, material->diffuse_name_size);
+      model->materials[i].diffuse_path = model_texture_path(arena, directory, name);
+    }
+    if(material->specular_name_size)
+    {
+      StringView name = str_view((char*)base + material->specular_name_offset, material->specular_name_size);
+      model->materials[i].specular_path = model_texture_path(arena, directory, name);
+    }
+  }
 
-        // Check if it has texture coordinates
-        if (index.texcoord_index >= 0)
-        {
-          vertex.tex_coords = {attrib.texcoords[2 * index.texcoord_index + 0],
-            1.0f - attrib.texcoords[2 * index.texcoord_index + 1]};
-        }
+  MeshNode** next = &model->meshes;
+  for(uint64_t i = 0; i < header->num_groups; i++)
+  {
+    CMeshGroup* group = cache_groups + i;
+    MeshNode* node = MODEL_POOL_PUSH(mesh_node_pool, MeshNode);
+    node->data = MODEL_POOL_PUSH(mesh_group_pool, MeshMaterialGroup);
+    MeshMaterialGroup* mesh = node->data;
+    // NOTE(ricardo): read-only mapping, nothing touches geometry after loading
+    mesh->packed_vertices = (PackedVertex*)(base + group->vertex_offset);
+    mesh->num_vertices = group->num_vertices;
+    mesh->packed_indices = base + group->index_offset;
+    mesh->num_indices = group->num_indices;
+    mesh->index_size = group->index_size;
+    mesh->num_lods = group->num_lods;
+    uint64_t first_index = 0;
+    for(uint32_t lod = 0; lod < group->num_lods; lod++)
+    {
+      mesh->lods[lod].first_index = first_index;
+      mesh->lods[lod].num_indices = group->lod_num_indices[lod];
+      mesh->lods[lod].error = group->lod_error[lod];
+      first_index += group->lod_num_indices[lod];
+    }
+    memcpy(mesh->position_offset.elements, group->position_offset, sizeof(group->position_offset));
+    memcpy(mesh->position_scale.elements, group->position_scale, sizeof(group->position_scale));
+    mesh->first_meshlet = group->first_meshlet;
+    mesh->num_meshlets = group->num_meshlets;
+    mesh->material_id = (int32_t)group->material_id;
+    if(mesh->material_id >= 0)
+      mesh->materials = model->materials[mesh->material_id];
+    *next = node;
+    next = &node->next;
 
-        // Check if it has normals
-        if (index.normal_index >= 0)
-        {
-          vertex.normal = {{attrib.normals[3 * index.normal_index + 0],
-            attrib.normals[3 * index.normal_index + 1],
-            attrib.normals[3 * index.normal_index + 2]}};
-        }
+    model->vertex_cache_before.num_triangles += group->lod_num_indices[0] / 3;
+    model->vertex_cache_before.num_vertices += group->num_vertices;
+  }
+  model->vertex_cache_after = model->vertex_cache_before;
+  model->vertex_cache_before.misses = header->vertex_cache_misses_before;
+  model->vertex_cache_after.misses = header->vertex_cache_misses_after;
 
-        // NOTE(ricardo): if the face_material_id is different we want to make it
-        // into another mesh
-        int face_material_id = shapes[s].mesh.material_ids[f];
-        if(previous_face_material_id != -1 &&
-            face_material_id != previous_face_material_id)
-        {
-          uint32_t model_num_vertices = mesh->data->num_vertices;
-          Vertex* newPtrV = mesh->data->vertices + model_num_vertices;
-          uint32_t model_num_indices = mesh->data->num_indices;
-          uint32_t* newPtrI = mesh->data->indices + model_num_indices;
-          mesh_index++;
-          previous_face_material_id = shapes[s].mesh.material_ids[f];
-
-          mesh->next = (MeshNode*)arena_push(arena, sizeof(MeshNode));
-          mesh = mesh->next;
-          mesh->data = (MeshMaterialGroup*)arena_push(arena, sizeof(MeshMaterialGroup));
-          mesh->data->vertices = newPtrV;
-          mesh->data->indices = newPtrI;
-          indice = 0;
-        }
-        uint32_t model_num_vertices = mesh->data->num_vertices++;
-        *(mesh->data->vertices + model_num_vertices) = vertex;
-        uint32_t model_num_indices = mesh->data->num_indices++;
-        // There some duplicate vertex data but this would mean to
-        // create a hash map for each vertex and store its index, slower?
-        // http://danglingpointers.com/post/mike-actons-dod-workshop-2015/
-        *(mesh->data->indices +  model_num_indices) = indice;
-        mesh->data->materials.diffuse_tex = all_materials[face_material_id].diffuse_tex;
-        mesh->data->materials.specular_tex = all_materials[face_material_id].specular_tex;
-        indice++;
+  ModelMeshlets* meshlets = &model->meshlets;
+  meshlets->count = header->num_meshlets;
+  meshlets->spheres = (idk_vec4*)(base + meshlet_arrays[0]);
+  meshlets->cones = (idk_vec4*)(base + meshlet_arrays[1]);
+  meshlets->bounds_min = (idk_vec3*)(base + meshlet_arrays[2]);
+  meshlets->bounds_max = (idk_vec3*)(base + meshlet_arrays[3]);
+  meshlets->first_index = meshlet_first_index;
+  meshlets->num_indices = meshlet_num_indices;
+  return model;
+}
+
+static void write_model_cache(Model* model, StringView directory, StringView cache_path, FileInfo source_info)
+{
+  if(!source_info.exists)
+    return;
+
+  TempArena scratch = scratch_begin(0, 0);
+  uint64_t num_groups = 0;
+  for(MeshNode* it = model->meshes; it != 0; it = it->next)
+    num_groups++;
+
+  CMeshHeader header = {};
+  header.magic = CMESH_MAGIC;
+  header.version = CMESH_VERSION;
+  header.vertex_size = sizeof(PackedVertex);
+  header.num_materials = model->num_materials;
+  header.num_groups = num_groups;
+  header.source_size = source_info.size;
+  header.source_modified_time = source_info.modified_time;
+  header.vertex_cache_misses_before = model->vertex_cache_before.misses;
+  header.vertex_cache_misses_after = model->vertex_cache_after.misses;
+
+  // Lay everything out first, then write it front to back
+  CMeshMaterial* cache_materials = (CMeshMaterial*)arena_push(scratch.arena, model->num_materials * sizeof(CMeshMaterial));
+  CMeshGroup* cache_groups = (CMeshGroup*)arena_push(scratch.arena, num_groups * sizeof(CMeshGroup));
+  uint64_t offset = sizeof(CMeshHeader) + model->num_materials * sizeof(CMeshMaterial) + num_groups * sizeof(CMeshGroup);
+
+  StringView normalized_directory = str_push_normalized_path(scratch.arena, directory);
+  StringBuilder names = str_builder_init(scratch.arena, Kilobytes(4));
+  for(uint32_t i = 0; i < model->num_materials; i++)
+  {
+    cache_materials[i].diffuse_name_offset = offset + names.chars.count;
+    cache_materials[i].diffuse_name_size =
+        cmesh_append_texture_name(&names, model->materials[i].diffuse_path, normalized_directory);
+
+    cache_materials[i].specular_name_offset = offset + names.chars.count;
+    cache_materials[i].specular_name_size =
+        cmesh_append_texture_name(&names, model->materials[i].specular_path, normalized_directory);
+  }
+  offset += names.chars.count;
+
+  uint64_t group_index = 0;
+  for(MeshNode* it = model->meshes; it != 0; it = it->next, group_index++)
+  {
+    CMeshGroup* group = cache_groups + group_index;
+    group->material_id = it->data->material_id;
+    group->num_vertices = it->data->num_vertices;
+    group->num_indices = it->data->num_indices;
+    group->index_size = it->data->index_size;
+    group->num_lods = it->data->num_lods;
+    for(uint32_t lod = 0; lod < it->data->num_lods; lod++)
+    {
+      group->lod_num_indices[lod] = it->data->lods[lod].num_indices;
+      group->lod_error[lod] = it->data->lods[lod].error;
+    }
+    memcpy(group->position_offset, it->data->position_offset.elements, sizeof(group->position_offset));
+    memcpy(group->position_scale, it->data->position_scale.elements, sizeof(group->position_scale));
+    offset = align_forward(offset, 16);
+    group->vertex_offset = offset;
+    offset += group->num_vertices * sizeof(PackedVertex);
+    offset = align_forward(offset, 16);
+    group->index_offset = offset;
+    offset += group->num_indices * group->index_size;
+    group->first_meshlet = it->data->first_meshlet;
+    group->num_meshlets = it->data->num_meshlets;
+  }
+  header.num_meshlets = model->meshlets.count;
+  header.meshlet_offset = offset;
+
+  // Write to a temporary file and rename it so a crash never leaves a
+  // truncated cache behind
+  StringView temp_path = str_push_concat(scratch.arena, cache_path, str_view(".tmp"));
+  FILE* file = fopen(temp_path.data, "wb");
+  if(file == 0)
+  {
+    printf("Failed to write mesh cache %s\n", temp_path.data);
+    scratch_end(scratch);
+    return;
+  }
+
+  bool ok = fwrite(&header, sizeof(header), 1, file) == 1;
+  ok = ok && fwrite(cache_materials, sizeof(CMeshMaterial), model->num_materials, file) == model->num_materials;
+  ok = ok && fwrite(cache_groups, sizeof(CMeshGroup), num_groups, file) == num_groups;
+  ok = ok && fwrite(names.chars.data, 1, names.chars.count, file) == names.chars.count;
+  offset = sizeof(CMeshHeader) + model->num_materials * sizeof(CMeshMaterial) + num_groups * sizeof(CMeshGroup) +
+    names.chars.count;
+  for(MeshNode* it = model->meshes; ok && it != 0; it = it->next)
+  {
+    MeshMaterialGroup* mesh = it->data;
+    ok = ok && write_padding(file, &offset, 16);
+    ok = ok && fwrite(mesh->packed_vertices, sizeof(PackedVertex), mesh->num_vertices, file) == mesh->num_vertices;
+    offset += mesh->num_vertices * sizeof(PackedVertex);
+    ok = ok && write_padding(file, &offset, 16);
+    ok = ok && fwrite(mesh->packed_indices, mesh->index_size, mesh->num_indices, file) == mesh->num_indices;
+    offset += mesh->num_indices * mesh->index_size;
+  }
+  ModelMeshlets* meshlets = &model->meshlets;
+  const void* meshlet_arrays[CMESH_MESHLET_ARRAYS] = {
+    meshlets->spheres, meshlets->cones, meshlets->bounds_min, meshlets->bounds_max, meshlets->first_index,
+    meshlets->num_indices
+  };
+  for(int i = 0; ok && i < CMESH_MESHLET_ARRAYS; i++)
+  {
+    ok = ok && write_padding(file, &offset, 16);
+    ok = ok && fwrite(meshlet_arrays[i], cmesh_meshlet_element_sizes[i], meshlets->count, file) == meshlets->count;
+    offset += meshlets->count * cmesh_meshlet_element_sizes[i];
+  }
+  ok = fclose(file) == 0 && ok;
+
+#ifdef _WIN32
+  // rename doesn't replace existing files on Windows
+  remove(cache_path.data);
+#endif
+  if(!ok || rename(temp_path.data, cache_path.data) != 0)
+  {
+    printf("Failed to write mesh cache %s\n", cache_path.data);
+    remove(temp_path.data);
+  }
+  scratch_end(scratch);
+}
+
+// Worker side of a load, only touches load->arena and the thread's scratch
+static void model_load_job(void* job_data)
+{
+  ModelLoad* load = (ModelLoad*)job_data;
+  Arena* arena = load->arena;
+  StringView path = load->path;
+  StringView directory = str_chop_last_slash(path);
+  TempArena scratch = scratch_begin(&arena, 1);
+  StringView cache_path = str_push_concat(scratch.arena, path, str_view(".cmesh"));
+  FileInfo source_info = get_file_info(path.data);
+
+  Model* model = load_model_cache(arena, directory, cache_path, source_info);
+  if(model != 0)
+  {
+    printf("Loaded %.*s from cache\n", (int)path.size, path.data);
+  }
+  else
+  {
+    model = load_model_obj(arena, path, directory);
+    if(model != 0)
+    {
+      optimize_model(arena, model);
+      pack_model(model);
+      write_model_cache(model, directory, cache_path, source_info);
+    }
+  }
+  scratch_end(scratch);
+  // Loading is the biggest transient user of the scratch arena, don't keep
+  // its pages resident for the rest of the session
+  arena_decommit(scratch.arena, scratch.pos);
+  load->result = model;
+}
+
+// Main thread, once the job is done
+static void model_apply_load(ModelLoad* load)
+{
+  Model* model = load->model;
+  Model* result = load->result;
+  if(result == 0)
+  {
+    printf("Failed to load model %.*s\n", (int)load->path.size, load->path.data);
+    model->state = ModelState_Failed;
+    return;
+  }
+  Arena* arena = model->arena;
+  MeshNode* groups = result->meshes;
+  *model = *result;
+  model->state = ModelState_Streaming;
+  model->meshes = 0;
+  model->load = load;
+  model->arena = arena;
+
+  // Placeholders until the images are decoded, the registry is main thread only
+  for(uint32_t i = 0; i < model->num_materials; i++)
+  {
+    Material* material = model->materials + i;
+    if(material->diffuse_path.size)
+      material->diffuse_tex = opengl_acquire_texture(material->diffuse_path, diffuse);
+    if(material->specular_path.size)
+      material->specular_tex = opengl_acquire_texture(material->specular_path, specular);
+  }
+  for(MeshNode* it = groups; it != 0; it = it->next)
+  {
+    if(it->data->material_id >= 0)
+      it->data->materials = model->materials[it->data->material_id];
+  }
+
+  place_model_geometry(model, groups);
+  load->pending = groups;
+  load->tail = &model->meshes;
+}
+
+// Uploads at least one pending group and then keeps going until the deadline
+static void model_upload_pending(ModelLoad* load, double deadline)
+{
+  do
+  {
+    MeshNode* node = load->pending;
+    if(node == 0)
+      break;
+    load->pending = node->next;
+    node->next = 0;
+    upload_mesh_group(node->data);
+    *load->tail = node;
+    load->tail = &node->next;
+  } while(glfwGetTime() < deadline);
+  if(load->pending == 0 && load->model->state == ModelState_Streaming)
+    load->model->state = ModelState_Ready;
+}
+
+static void unlink_streaming_model(ModelLoad* load)
+{
+  for(ModelLoad** it = &streaming_models; *it != 0; it = &(*it)->next)
+  {
+    if(*it == load)
+    {
+      *it = load->next;
+      return;
+    }
+  }
+}
+
+void stream_models(double budget_seconds)
+{
+  double deadline = glfwGetTime() + budget_seconds;
+  ModelLoad** it = &streaming_models;
+  while(*it != 0)
+  {
+    ModelLoad* load = *it;
+    Model* model = load->model;
+    if(model->state == ModelState_Loading)
+    {
+      if(load->counter.pending > 0)
+      {
+        it = &load->next;
+        continue;
       }
-      index_offset+=fv;
-      previous_face_material_id = shapes[s].mesh.material_ids[f];
+      model_apply_load(load);
     }
-    mesh_index++;
+    model_upload_pending(load, deadline);
+    if(model->state == ModelState_Ready || model->state == ModelState_Failed)
+      *it = load->next;
+    else
+      it = &load->next;
   }
 
-  // Create OpenGL objects
-  MeshNode* mesh_node = model->meshes;
+  double remaining = deadline - glfwGetTime();
+  opengl_upload_textures(remaining > 0.0 ? remaining : 0.0);
+}
+
+Model* create_model(Arena* arena, StringView path)
+{
+  ModelLoad load = {};
+  load.arena = arena;
+  load.path = path;
+  model_load_job(&load);
+  // A failed load still hands out an (empty) model
+  load.model = load.result ? load.result : (Model*)arena_push(arena, sizeof(Model));
+  model_apply_load(&load);
+  model_upload_pending(&load, HUGE_VAL);
+  Model* model = load.model;
+  model->load = 0;
+  // Textures were decoding on the workers while the geometry got built
+  opengl_finish_texture_uploads();
+  return model;
+}
+
+Model* create_model_async(StringView path)
+{
+  // NOTE(ricardo): holds all the geometry, which gets touched linearly on
+  // load and upload so 2 MB pages save a lot of TLB misses
+  Arena* arena = arena_alloc_flags(Gigabytes(4), "Model", ArenaTag_Assets, ArenaFlag_LargePages);
+  Model* model = (Model*)arena_push(arena, sizeof(Model));
+  ModelLoad* load = (ModelLoad*)arena_push(arena, sizeof(ModelLoad));
+  load->model = model;
+  load->arena = arena;
+  load->path = str_push_copy(arena, path);
+  model->state = ModelState_Loading;
+  model->load = load;
+  model->arena = arena;
+
+  ModelLoad** tail = &streaming_models;
+  while(*tail != 0)
+    tail = &(*tail)->next;
+  *tail = load;
+  job_push(model_load_job, load, &load->counter);
+  return model;
+}
+
+static void free_mesh_nodes(MeshNode* mesh_node)
+{
   while(mesh_node != 0)
   {
     MeshMaterialGroup* mesh = mesh_node->data;
-    if (mesh->num_vertices != 0 )
+    model_pool_free(mesh_group_pool, mesh);
+
+    MeshNode* next = mesh_node->next;
+    model_pool_free(mesh_node_pool, mesh_node);
+    mesh_node = next;
+  }
+}
+
+void destroy_model(Model* model)
+{
+  ModelLoad* load = model->load;
+  if(model->state == ModelState_Loading)
+  {
+    // NOTE(ricardo): nothing acquired or placed yet, don't apply the load just
+    // to tear it down. Only the job's groups and cache mapping are outside the
+    // arena.
+    job_wait(&load->counter);
+    if(load->result)
     {
-      mesh->vao = opengl_create_vertex_array(arena);
-      mesh->vbo = opengl_create_vertex_buffer(arena, mesh->vertices, mesh->num_vertices * sizeof(Vertex));
-      mesh->ibo = opengl_create_index_buffer(arena, (const void*)(mesh->indices), mesh->num_indices);
-      int enabled_attribs = 0;
-      int stride = 32;
-      int offset = 0;
-      // Position
-      opengl_add_element_to_layout(DataType::Float3, false, &enabled_attribs, stride, &offset, mesh->vao,
-          mesh->vbo);
-      // Normals
-      opengl_add_element_to_layout(DataType::Float3, false, &enabled_attribs, stride, &offset, mesh->vao,
-          mesh->vbo);
-      // Texture Coords
-      opengl_add_element_to_layout(DataType::Float2, false, &enabled_attribs, stride, &offset, mesh->vao,
-          mesh->vbo);
+      free_mesh_nodes(load->result->meshes);
+      unmap_file(&load->result->cache);
     }
-    mesh_node = mesh_node->next;
   }
-  return model;
+  if(model->state == ModelState_Loading || model->state == ModelState_Failed)
+  {
+    // Nothing was placed or acquired, the rest is in the arena
+    if(load)
+      unlink_streaming_model(load);
+    if(model->arena)
+      arena_release(model->arena);
+    return;
+  }
+  if(model->state == ModelState_Streaming)
+  {
+    *load->tail = load->pending;
+    load->pending = 0;
+    unlink_streaming_model(load);
+  }
+
+  // NOTE(ricardo): vertex/index data lives in the arena passed to create_model
+  // and goes away with it, here we only give back GPU objects and nodes
+  model_geometry_free(model);
+  free_mesh_nodes(model->meshes);
+  model->meshes = 0;
+
+  for(uint32_t i = 0; i < model->num_materials; i++)
+  {
+    Material* material = model->materials + i;
+    if(material->diffuse_tex)
+      opengl_release_texture(material->diffuse_tex);
+    if(material->specular_tex)
+      opengl_release_texture(material->specular_tex);
+  }
+  model->num_materials = 0;
+  unmap_file(&model->cache);
+  // The model itself lives in there too
+  if(model->arena)
+    arena_release(model->arena);
 }
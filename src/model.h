@@ -2,6 +2,7 @@
 
 #include "opengl_renderer.h"
 #include "memory.h"
+#include "mesh_optimize.h"
 #include "idk_math.h"
 
 struct Vertex
@@ -12,27 +13,73 @@ struct Vertex
 
   bool operator==(const Vertex& other) const
   {
-    return position == other.position && tex_coords == other.tex_coords;
+    return position == other.position && normal == other.normal && tex_coords == other.tex_coords;
   }
 };
 
+// What gets uploaded and cached, 16 bytes. The position is unorm16 inside the
+// group bounds, the normal octahedral encoded into the first two 10 bit
+// fields of a 2_10_10_10 word and the texture coordinates are half floats.
+struct PackedVertex
+{
+  uint16_t position[4]; // w is padding
+  uint32_t normal;
+  uint16_t tex_coords[2];
+};
+
 struct Material
 {
   Texture* diffuse_tex;
   Texture* specular_tex;
+  // Normalized, the textures only get acquired on the main thread once the
+  // model is loaded
+  StringView diffuse_path;
+  StringView specular_path;
 };
 
+// Every group has up to MODEL_MAX_LODS index ranges into the same vertices,
+// each roughly half the triangles of the one before
+#define MODEL_MAX_LODS 4
+// Simplification gives up once a level is off by more than this fraction of
+// the group's bounding box diagonal
+#define MODEL_LOD_MAX_ERROR 0.1f
+// Groups with fewer triangles only get the full detail level
+#define MODEL_LOD_MIN_TRIANGLES 64
+
+struct MeshLod
+{
+  uint64_t first_index;
+  uint64_t num_indices;
+  float error; // How far the surface moved from lods[0], in model units
+};
+
+// All faces of one material, whichever OBJ shapes they came from
 struct MeshMaterialGroup
 {
+  // Only while the model gets built, pack_model overwrites them
   Vertex* vertices;
   uint64_t num_vertices;
   uint32_t* indices;
-  uint64_t num_indices;
+  uint64_t num_indices; // Of all lods together
+  MeshLod lods[MODEL_MAX_LODS]; // lods[0] is the full mesh
+  uint32_t num_lods;
   Material materials;
+  int32_t material_id; // -1 if the faces have no material
+
+  PackedVertex* packed_vertices;
+  void* packed_indices;
+  uint32_t index_size; // 2 bytes when the group has at most 65536 vertices
+  // position = position_offset + unorm16 position * position_scale
+  idk_vec3 position_offset;
+  idk_vec3 position_scale;
+
+  // Where the group landed in the shared geometry buffers
+  uint32_t base_vertex;
+  uint64_t index_offset; // In bytes
 
-  VertexArray* vao;
-  VertexBuffer* vbo;
-  IndexBuffer* ibo;
+  // Range of the model's meshlets that split up lods[0]
+  uint64_t first_meshlet;
+  uint64_t num_meshlets;
 };
 
 struct MeshNode
@@ -41,11 +88,79 @@ struct MeshNode
   MeshNode* next;
 };
 
+// Meshlets of every group, struct of arrays so culling only streams through
+// what it tests. Bounds are in model space.
+struct ModelMeshlets
+{
+  uint64_t count;
+  idk_vec4* spheres; // xyz center, w radius
+  idk_vec4* cones; // xyz axis, w cutoff (see Meshlet)
+  idk_vec3* bounds_min;
+  idk_vec3* bounds_max;
+  uint32_t* first_index; // Into the group's lods[0]
+  uint32_t* num_indices;
+};
+
+// Everything draw needs to pick LODs and cull, see make_draw_view
+struct DrawView
+{
+  idk_vec3 camera_position;
+  // Turns size / distance into pixels, projection[1][1] times half the
+  // viewport height
+  float projection_scale;
+  float max_pixel_error;
+  idk_vec4 frustum[6]; // World space planes, xyz points inside
+  bool cull_meshlets;
+};
+
+enum ModelState
+{
+  ModelState_Loading, // The job is still parsing or reading the cache, nothing to draw
+  ModelState_Streaming, // Groups show up in meshes as they get uploaded
+  ModelState_Ready,
+  ModelState_Failed // Stays empty, the error got logged
+};
+
+struct ModelLoad;
+
 struct Model
 {
+  ModelState state;
   MeshNode* meshes; // Head of linked list
+  Material* materials; // Holds a registry reference to each texture
+  uint32_t num_materials;
+  MappedFile cache; // Geometry points into this when loaded from a .cmesh
+  // Summed over all groups, before and after optimize_model
+  VertexCacheStats vertex_cache_before;
+  VertexCacheStats vertex_cache_after;
+  // Range of the shared geometry buffers the groups were uploaded into
+  uint64_t geometry_first_vertex;
+  uint64_t geometry_num_vertices;
+  uint64_t geometry_index_offset; // In bytes
+  uint64_t geometry_index_bytes;
+  ModelMeshlets meshlets;
+  ModelLoad* load; // Until the model is destroyed, 0 for create_model
+  Arena* arena; // Owned by models from create_model_async
 };
 
-Model* create_model(Arena* arena, const std::string& path);
-void draw(Model* model, const idk_mat4& transform, OpenGLProgramCommon* shader);
+// NOTE(ricardo): path must be null terminated. The processed geometry gets
+// cached next to it as <path>.cmesh and reused while the source is unchanged
+Model* create_model(Arena* arena, StringView path);
+// Returns right away in ModelState_Loading, the model gets parsed (or read from
+// its cache) on a job worker into an arena of its own and stream_models does
+// the rest. Can be drawn and destroyed in any state.
+Model* create_model_async(StringView path);
+// Main thread, once per frame: picks up finished loads and uploads groups and
+// textures until budget_seconds are used up. Every loading model gets at least
+// one group and one texture goes up per call.
+void stream_models(double budget_seconds);
+void destroy_model(Model* model);
+DrawView make_draw_view(idk_vec3 camera_position, const idk_mat4& projection, const idk_mat4& view,
+    float viewport_height, float max_pixel_error);
+// All models live in one vertex and one index buffer behind a single VAO.
+// Every group is drawn at the coarsest LOD that view allows and groups and
+// meshlets outside the frustum or facing away are skipped. Without a view
+// everything is drawn at full detail. Returns the number of triangles drawn.
+// Culled meshlet ranges go into frame_arena().
+uint64_t draw(Model* model, const idk_mat4& transform, OpenGLProgramCommon* shader, const DrawView* view);
 
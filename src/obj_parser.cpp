@@ -0,0 +1,1006 @@
+// #include "obj_parser.h"
+#include <float.h>
+#include <math.h>
+#include <stdio.h>
+#include <string.h>
+
+// #include "memory.h"
+// #include "opengl_renderer.h"
+
+#define OBJ_PARSER_MAX_CHUNKS 64
+#define OBJ_PARSER_MIN_CHUNK_SIZE Megabytes(1)
+
+// -1 if the corner doesn't have that attribute
+struct ObjIndex
+{
+  int32_t vertex_index;
+  int32_t normal_index;
+  int32_t texcoord_index;
+};
+
+// Texture names as written in the .mtl, size 0 if the material has none
+struct ObjMaterial
+{
+  StringView name;
+  StringView diffuse_texname;
+  StringView specular_texname;
+  StringView bump_texname;
+};
+
+// Always triangulated, 3 indices per face
+struct ObjShape
+{
+  ObjIndex* indices;
+  int32_t* material_ids;
+  uint64_t num_faces;
+};
+
+struct ObjData
+{
+  float* positions; // 3 per vertex
+  uint64_t num_positions;
+  float* texcoords; // 2 per vertex
+  uint64_t num_texcoords;
+  float* normals; // 3 per vertex
+  uint64_t num_normals;
+  ObjShape* shapes;
+  uint64_t num_shapes;
+  ObjMaterial* materials;
+  uint32_t num_materials;
+};
+
+#define OBJ_IS_SPACE(c) ((c) == ' ' || (c) == '\t')
+#define OBJ_IS_DIGIT(c) ((unsigned int)((c) - '0') < 10u)
+
+enum ObjCommandType
+{
+  ObjCommand_UseMaterial,
+  ObjCommand_Group, // g and o, both start a new shape
+  ObjCommand_MaterialLibrary,
+};
+
+// Anything that changes state while walking the faces, kept in file order
+struct ObjCommand
+{
+  ObjCommandType type;
+  uint64_t face; // Faces of the chunk that come before the command
+  StringView argument; // Points into the mapped file
+};
+
+// Corners hold the raw OBJ indices (1 based, negative is relative, 0 means
+// missing) until the second pass knows the global counts
+struct ObjFace
+{
+  uint64_t first_corner;
+  uint64_t num_corners;
+  uint64_t first_triangle;
+  // Chunk local counts when the face was read, base for relative indices
+  uint64_t num_positions;
+  uint64_t num_texcoords;
+  uint64_t num_normals;
+};
+
+struct ObjChunk
+{
+  const char* begin;
+  const char* end;
+  Arena* arena;
+  uint64_t num_lines;
+  uint64_t error_line; // Chunk local, 0 if the chunk parsed fine
+
+  Array<float> positions;
+  Array<float> texcoords;
+  Array<float> normals;
+  Array<ObjIndex> corners;
+  Array<ObjFace> faces;
+  Array<ObjCommand> commands;
+  Array<ObjIndex> triangles; // 3 per triangle, filled by the second pass
+
+  // Where the attributes of this chunk start in the global arrays
+  uint64_t position_base;
+  uint64_t texcoord_base;
+  uint64_t normal_base;
+  ObjData* data;
+};
+
+// Faces between two commands, all with the same material
+struct ObjSegment
+{
+  ObjChunk* chunk;
+  uint64_t first_triangle;
+  uint64_t num_triangles;
+  int32_t material_id;
+};
+
+// Lines end at '\n', "\r\n" or a lone '\r' like tinyobj's safeGetline
+static const char* obj_line_end(const char* at, const char* end)
+{
+  while(at < end && *at != '\n' && *at != '\r')
+    at++;
+  return at;
+}
+
+static const char* obj_next_line(const char* line_end, const char* end)
+{
+  if(line_end < end && *line_end == '\r')
+  {
+    line_end++;
+    if(line_end < end && *line_end == '\n')
+      line_end++;
+  }
+  else if(line_end < end)
+  {
+    line_end++;
+  }
+  return line_end;
+}
+
+static const char* obj_skip_space(const char* at, const char* end)
+{
+  while(at < end && OBJ_IS_SPACE(*at))
+    at++;
+  return at;
+}
+
+static const char* obj_skip_token(const char* at, const char* end)
+{
+  while(at < end && !OBJ_IS_SPACE(*at) && *at != '\r')
+    at++;
+  return at;
+}
+
+// Keyword followed by a space or a tab
+static bool obj_keyword(const char* at, const char* end, const char* keyword, uint64_t size)
+{
+  return (uint64_t)(end - at) > size && memcmp(at, keyword, size) == 0 && OBJ_IS_SPACE(at[size]);
+}
+
+// NOTE(ricardo): same algorithm as tinyobj's tryParseDouble so both produce
+// the same floats bit for bit, strtod rounds differently in the last digit
+static bool obj_parse_double(const char* s, const char* s_end, double* result)
+{
+  if(s >= s_end)
+    return false;
+
+  double mantissa = 0.0;
+  int exponent = 0;
+  char sign = '+';
+  char exp_sign = '+';
+  const char* curr = s;
+  int read = 0;
+  bool leading_decimal_dots = false;
+
+  if(*curr == '+' || *curr == '-')
+  {
+    sign = *curr;
+    curr++;
+    if(curr != s_end && *curr == '.')
+      leading_decimal_dots = true;
+  }
+  else if(OBJ_IS_DIGIT(*curr))
+  {
+  }
+  else if(*curr == '.')
+  {
+    leading_decimal_dots = true;
+  }
+  else
+  {
+    return false;
+  }
+
+  // Integer part
+  if(!leading_decimal_dots)
+  {
+    while(curr != s_end && OBJ_IS_DIGIT(*curr))
+    {
+      mantissa *= 10;
+      mantissa += (int)(*curr - '0');
+      curr++;
+      read++;
+    }
+    if(read == 0)
+      return false;
+  }
+
+  if(curr != s_end)
+  {
+    // Decimal part
+    if(*curr == '.')
+    {
+      static const double pow_lut[] = {1.0, 0.1, 0.01, 0.001, 0.0001, 0.00001, 0.000001, 0.0000001};
+      const int lut_entries = sizeof(pow_lut) / sizeof(pow_lut[0]);
+      curr++;
+      read = 1;
+      while(curr != s_end && OBJ_IS_DIGIT(*curr))
+      {
+        mantissa += (int)(*curr - '0') * (read < lut_entries ? pow_lut[read] : pow(10.0, -read));
+        read++;
+        curr++;
+      }
+    }
+    else if(*curr != 'e' && *curr != 'E')
+    {
+      curr = s_end;
+    }
+
+    // Exponent part
+    if(curr != s_end && (*curr == 'e' || *curr == 'E'))
+    {
+      curr++;
+      if(curr != s_end && (*curr == '+' || *curr == '-'))
+      {
+        exp_sign = *curr;
+        curr++;
+      }
+      else if(curr == s_end || !OBJ_IS_DIGIT(*curr))
+      {
+        return false;
+      }
+
+      read = 0;
+      while(curr != s_end && OBJ_IS_DIGIT(*curr))
+      {
+        if(exponent > 2147483647 / 10)
+          return false;
+        exponent *= 10;
+        exponent += (int)(*curr - '0');
+        curr++;
+        read++;
+      }
+      exponent *= (exp_sign == '+' ? 1 : -1);
+      if(read == 0)
+        return false;
+    }
+  }
+
+  *result = (sign == '+' ? 1 : -1) * (exponent ? ldexp(mantissa * pow(5.0, exponent), exponent) : mantissa);
+  return true;
+}
+
+static float obj_parse_float(const char** at, const char* end)
+{
+  *at = obj_skip_space(*at, end);
+  const char* token_end = obj_skip_token(*at, end);
+  double value = 0.0;
+  obj_parse_double(*at, token_end, &value);
+  *at = token_end;
+  return (float)value;
+}
+
+// Same as atoi but stops at the end of the line
+static int32_t obj_parse_int(const char* at, const char* end)
+{
+  while(at < end && (OBJ_IS_SPACE(*at) || *at == '\v' || *at == '\f'))
+    at++;
+  bool negative = false;
+  if(at < end && (*at == '+' || *at == '-'))
+  {
+    negative = *at == '-';
+    at++;
+  }
+  int64_t value = 0;
+  while(at < end && OBJ_IS_DIGIT(*at) && value <= INT32_MAX)
+  {
+    value = value * 10 + (*at - '0');
+    at++;
+  }
+  return (int32_t)(negative ? -value : value);
+}
+
+static const char* obj_skip_index(const char* at, const char* end)
+{
+  while(at < end && *at != '/' && !OBJ_IS_SPACE(*at) && *at != '\r')
+    at++;
+  return at;
+}
+
+// v, v/vt, v//vn or v/vt/vn. Returns false for a 0 index, the spec doesn't
+// allow it and tinyobj fails the whole file on it
+static bool obj_parse_corner(const char** at, const char* end, ObjIndex* corner)
+{
+  corner->vertex_index = obj_parse_int(*at, end);
+  corner->texcoord_index = 0;
+  corner->normal_index = 0;
+  if(corner->vertex_index == 0)
+    return false;
+
+  *at = obj_skip_index(*at, end);
+  if(*at == end || **at != '/')
+    return true;
+  (*at)++;
+
+  if(*at < end && **at == '/')
+  {
+    (*at)++;
+    corner->normal_index = obj_parse_int(*at, end);
+    *at = obj_skip_index(*at, end);
+    return corner->normal_index != 0;
+  }
+
+  corner->texcoord_index = obj_parse_int(*at, end);
+  if(corner->texcoord_index == 0)
+    return false;
+  *at = obj_skip_index(*at, end);
+  if(*at == end || **at != '/')
+    return true;
+  (*at)++;
+
+  corner->normal_index = obj_parse_int(*at, end);
+  *at = obj_skip_index(*at, end);
+  return corner->normal_index != 0;
+}
+
+// First pass, one job per chunk
+static void obj_parse_chunk(void* job_data)
+{
+  ObjChunk* chunk = (ObjChunk*)job_data;
+  // NOTE(ricardo): rough guess so the arrays don't start tiny, they grow anyway
+  uint64_t estimate = (chunk->end - chunk->begin) / 64 + 16;
+  chunk->commands = array_init<ObjCommand>(chunk->arena, 64);
+  chunk->positions = array_init<float>(chunk->arena, estimate);
+  chunk->texcoords = array_init<float>(chunk->arena, estimate);
+  chunk->normals = array_init<float>(chunk->arena, estimate);
+  chunk->faces = array_init<ObjFace>(chunk->arena, estimate / 2);
+  chunk->corners = array_init<ObjIndex>(chunk->arena, estimate);
+
+  const char* end = chunk->end;
+  const char* next = 0;
+  for(const char* at = chunk->begin; at < end; at = next)
+  {
+    const char* line_end = obj_line_end(at, end);
+    next = obj_next_line(line_end, end);
+    chunk->num_lines++;
+
+    const char* token = obj_skip_space(at, line_end);
+    if(token == line_end || *token == '#')
+      continue;
+
+    if(obj_keyword(token, line_end, "v", 1))
+    {
+      token += 2;
+      array_push(&chunk->positions, obj_parse_float(&token, line_end));
+      array_push(&chunk->positions, obj_parse_float(&token, line_end));
+      array_push(&chunk->positions, obj_parse_float(&token, line_end));
+    }
+    else if(obj_keyword(token, line_end, "vn", 2))
+    {
+      token += 3;
+      array_push(&chunk->normals, obj_parse_float(&token, line_end));
+      array_push(&chunk->normals, obj_parse_float(&token, line_end));
+      array_push(&chunk->normals, obj_parse_float(&token, line_end));
+    }
+    else if(obj_keyword(token, line_end, "vt", 2))
+    {
+      token += 3;
+      array_push(&chunk->texcoords, obj_parse_float(&token, line_end));
+      array_push(&chunk->texcoords, obj_parse_float(&token, line_end));
+    }
+    else if(obj_keyword(token, line_end, "f", 1))
+    {
+      ObjFace face = {};
+      face.first_corner = chunk->corners.count;
+      face.num_positions = chunk->positions.count / 3;
+      face.num_texcoords = chunk->texcoords.count / 2;
+      face.num_normals = chunk->normals.count / 3;
+
+      token = obj_skip_space(token + 2, line_end);
+      while(token < line_end)
+      {
+        ObjIndex corner;
+        if(!obj_parse_corner(&token, line_end, &corner))
+        {
+          chunk->error_line = chunk->num_lines;
+          return;
+        }
+        array_push(&chunk->corners, corner);
+        while(token < line_end && (OBJ_IS_SPACE(*token) || *token == '\r'))
+          token++;
+      }
+      face.num_corners = chunk->corners.count - face.first_corner;
+      array_push(&chunk->faces, face);
+    }
+    else if(line_end - token >= 6 && memcmp(token, "usemtl", 6) == 0)
+    {
+      const char* name = obj_skip_space(token + 6, line_end);
+      ObjCommand command = {ObjCommand_UseMaterial, chunk->faces.count};
+      command.argument = str_view(name, obj_skip_token(name, line_end) - name);
+      array_push(&chunk->commands, command);
+    }
+    else if(obj_keyword(token, line_end, "mtllib", 6))
+    {
+      ObjCommand command = {ObjCommand_MaterialLibrary, chunk->faces.count};
+      command.argument = str_view(token + 7, line_end - token - 7);
+      array_push(&chunk->commands, command);
+    }
+    else if(obj_keyword(token, line_end, "g", 1) || obj_keyword(token, line_end, "o", 1))
+    {
+      ObjCommand command = {ObjCommand_Group, chunk->faces.count};
+      array_push(&chunk->commands, command);
+    }
+  }
+}
+
+static void obj_copy_attributes(void* job_data)
+{
+  ObjChunk* chunk = (ObjChunk*)job_data;
+  ObjData* data = chunk->data;
+  memcpy(data->positions + chunk->position_base * 3, chunk->positions.data, chunk->positions.count * sizeof(float));
+  memcpy(data->texcoords + chunk->texcoord_base * 2, chunk->texcoords.data, chunk->texcoords.count * sizeof(float));
+  memcpy(data->normals + chunk->normal_base * 3, chunk->normals.data, chunk->normals.count * sizeof(float));
+}
+
+// Makes an index 0 based, relative ones count back from the number of
+// elements read so far, -1 is missing
+static int32_t obj_fix_index(int32_t index, uint64_t count)
+{
+  if(index > 0)
+    return index - 1;
+  if(index < 0)
+    return (int32_t)count + index;
+  return -1;
+}
+
+// https://wrf.ecse.rpi.edu//Research/Short_Notes/pnpoly.html
+static bool obj_point_in_triangle(float* vx, float* vy, float tx, float ty)
+{
+  bool inside = false;
+  for(int i = 0, j = 2; i < 3; j = i++)
+  {
+    if(((vy[i] > ty) != (vy[j] > ty)) && (tx < (vx[j] - vx[i]) * (ty - vy[i]) / (vy[j] - vy[i]) + vx[i]))
+      inside = !inside;
+  }
+  return inside;
+}
+
+static void obj_push_triangle(Array<ObjIndex>* triangles, ObjIndex a, ObjIndex b, ObjIndex c)
+{
+  array_push(triangles, a);
+  array_push(triangles, b);
+  array_push(triangles, c);
+}
+
+// NOTE(ricardo): this follows tinyobj's triangulation step by step, quads are
+// split along the shorter diagonal and anything bigger goes through its ear
+// clipping so we end up with exactly the same triangles
+static void obj_triangulate(Array<ObjIndex>* triangles, Array<ObjIndex>* polygon, ObjIndex* corners,
+    uint64_t num_corners, float* v, uint64_t v_size)
+{
+  if(num_corners < 3)
+    return;
+
+  if(num_corners == 3)
+  {
+    obj_push_triangle(triangles, corners[0], corners[1], corners[2]);
+    return;
+  }
+
+  if(num_corners == 4)
+  {
+    size_t vi0 = (size_t)corners[0].vertex_index;
+    size_t vi1 = (size_t)corners[1].vertex_index;
+    size_t vi2 = (size_t)corners[2].vertex_index;
+    size_t vi3 = (size_t)corners[3].vertex_index;
+    if(3 * vi0 + 2 >= v_size || 3 * vi1 + 2 >= v_size || 3 * vi2 + 2 >= v_size || 3 * vi3 + 2 >= v_size)
+      return;
+
+    float e02x = v[vi2 * 3 + 0] - v[vi0 * 3 + 0];
+    float e02y = v[vi2 * 3 + 1] - v[vi0 * 3 + 1];
+    float e02z = v[vi2 * 3 + 2] - v[vi0 * 3 + 2];
+    float e13x = v[vi3 * 3 + 0] - v[vi1 * 3 + 0];
+    float e13y = v[vi3 * 3 + 1] - v[vi1 * 3 + 1];
+    float e13z = v[vi3 * 3 + 2] - v[vi1 * 3 + 2];
+    float sqr02 = e02x * e02x + e02y * e02y + e02z * e02z;
+    float sqr13 = e13x * e13x + e13y * e13y + e13z * e13z;
+    if(sqr02 < sqr13)
+    {
+      obj_push_triangle(triangles, corners[0], corners[1], corners[2]);
+      obj_push_triangle(triangles, corners[0], corners[2], corners[3]);
+    }
+    else
+    {
+      obj_push_triangle(triangles, corners[0], corners[1], corners[3]);
+      obj_push_triangle(triangles, corners[1], corners[2], corners[3]);
+    }
+    return;
+  }
+
+  // Find the two axes to project the polygon on
+  size_t axes[2] = {1, 2};
+  for(uint64_t k = 0; k < num_corners; k++)
+  {
+    size_t vi0 = (size_t)corners[(k + 0) % num_corners].vertex_index;
+    size_t vi1 = (size_t)corners[(k + 1) % num_corners].vertex_index;
+    size_t vi2 = (size_t)corners[(k + 2) % num_corners].vertex_index;
+    if(3 * vi0 + 2 >= v_size || 3 * vi1 + 2 >= v_size || 3 * vi2 + 2 >= v_size)
+      continue;
+
+    float e0x = v[vi1 * 3 + 0] - v[vi0 * 3 + 0];
+    float e0y = v[vi1 * 3 + 1] - v[vi0 * 3 + 1];
+    float e0z = v[vi1 * 3 + 2] - v[vi0 * 3 + 2];
+    float e1x = v[vi2 * 3 + 0] - v[vi1 * 3 + 0];
+    float e1y = v[vi2 * 3 + 1] - v[vi1 * 3 + 1];
+    float e1z = v[vi2 * 3 + 2] - v[vi1 * 3 + 2];
+    float cx = fabsf(e0y * e1z - e0z * e1y);
+    float cy = fabsf(e0z * e1x - e0x * e1z);
+    float cz = fabsf(e0x * e1y - e0y * e1x);
+    if(cx > FLT_EPSILON || cy > FLT_EPSILON || cz > FLT_EPSILON)
+    {
+      if(!(cx > cy && cx > cz))
+      {
+        axes[0] = 0;
+        if(cz > cx && cz > cy)
+          axes[1] = 1;
+      }
+      break;
+    }
+  }
+
+  polygon->count = 0;
+  for(uint64_t k = 0; k < num_corners; k++)
+    array_push(polygon, corners[k]);
+
+  size_t guess_vert = 0;
+  ObjIndex ind[3];
+  float vx[3];
+  float vy[3];
+  // How many tries are left without clipping an ear before we give up
+  size_t remaining_iterations = num_corners;
+  size_t previous_remaining_vertices = num_corners;
+  while(polygon->count > 3 && remaining_iterations > 0)
+  {
+    size_t npolys = polygon->count;
+    if(guess_vert >= npolys)
+      guess_vert -= npolys;
+
+    if(previous_remaining_vertices != npolys)
+    {
+      previous_remaining_vertices = npolys;
+      remaining_iterations = npolys;
+    }
+    else
+    {
+      remaining_iterations--;
+    }
+
+    for(size_t k = 0; k < 3; k++)
+    {
+      ind[k] = polygon->data[(guess_vert + k) % npolys];
+      size_t vi = (size_t)ind[k].vertex_index;
+      if(vi * 3 + axes[0] >= v_size || vi * 3 + axes[1] >= v_size)
+      {
+        vx[k] = 0.0f;
+        vy[k] = 0.0f;
+      }
+      else
+      {
+        vx[k] = v[vi * 3 + axes[0]];
+        vy[k] = v[vi * 3 + axes[1]];
+      }
+    }
+
+    // Skip internal angles
+    float e0x = vx[1] - vx[0];
+    float e0y = vy[1] - vy[0];
+    float e1x = vx[2] - vx[1];
+    float e1y = vy[2] - vy[1];
+    float cross = e0x * e1y - e0y * e1x;
+    float area = (vx[0] * vy[1] - vy[0] * vx[1]) * 0.5f;
+    if(cross * area < 0.0f)
+    {
+      guess_vert += 1;
+      continue;
+    }
+
+    // No other vertex can be inside the ear
+    bool overlap = false;
+    for(size_t other = 3; other < npolys; other++)
+    {
+      size_t ovi = (size_t)polygon->data[(guess_vert + other) % npolys].vertex_index;
+      if(ovi * 3 + axes[0] >= v_size || ovi * 3 + axes[1] >= v_size)
+        continue;
+      if(obj_point_in_triangle(vx, vy, v[ovi * 3 + axes[0]], v[ovi * 3 + axes[1]]))
+      {
+        overlap = true;
+        break;
+      }
+    }
+    if(overlap)
+    {
+      guess_vert += 1;
+      continue;
+    }
+
+    obj_push_triangle(triangles, ind[0], ind[1], ind[2]);
+
+    // Remove the tip of the ear
+    for(size_t removed = (guess_vert + 1) % npolys; removed + 1 < npolys; removed++)
+      polygon->data[removed] = polygon->data[removed + 1];
+    polygon->count--;
+  }
+
+  if(polygon->count == 3)
+    obj_push_triangle(triangles, polygon->data[0], polygon->data[1], polygon->data[2]);
+}
+
+// Second pass, needs the global attribute arrays to be complete
+static void obj_triangulate_chunk(void* job_data)
+{
+  ObjChunk* chunk = (ObjChunk*)job_data;
+  ObjData* data = chunk->data;
+  // NOTE(ricardo): triangles go last so they can keep growing in place
+  Array<ObjIndex> polygon = array_init<ObjIndex>(chunk->arena, 64);
+  chunk->triangles = array_init<ObjIndex>(chunk->arena, chunk->corners.count + 16);
+
+  for(uint64_t i = 0; i < chunk->faces.count; i++)
+  {
+    ObjFace* face = chunk->faces.data + i;
+    ObjIndex* corners = chunk->corners.data + face->first_corner;
+    for(uint64_t k = 0; k < face->num_corners; k++)
+    {
+      corners[k].vertex_index = obj_fix_index(corners[k].vertex_index, chunk->position_base + face->num_positions);
+      corners[k].texcoord_index = obj_fix_index(corners[k].texcoord_index, chunk->texcoord_base + face->num_texcoords);
+      corners[k].normal_index = obj_fix_index(corners[k].normal_index, chunk->normal_base + face->num_normals);
+    }
+    face->first_triangle = chunk->triangles.count / 3;
+    obj_triangulate(&chunk->triangles, &polygon, corners, face->num_corners, data->positions, data->num_positions * 3);
+  }
+}
+
+// Runs work on every chunk, the first one on the calling thread
+static void obj_run_parallel(ObjChunk* chunks, uint32_t count, JobFunction* work)
+{
+  JobCounter counter = {};
+  for(uint32_t i = 1; i < count; i++)
+    job_push(work, chunks + i, &counter);
+  work(chunks);
+  job_wait(&counter);
+}
+
+// Texture statements can start with options like "-bm 0.5", the name is the
+// rest of the line after them so it may contain spaces
+static bool obj_texture_name(const char* at, const char* end, StringView* name)
+{
+  struct TextureOption
+  {
+    const char* name;
+    uint64_t size;
+    uint32_t num_arguments;
+  };
+  static const TextureOption options[] = {
+    {"-blendu", 7, 1}, {"-blendv", 7, 1}, {"-clamp", 6, 1}, {"-boost", 6, 1},
+    {"-bm", 3, 1}, {"-o", 2, 3}, {"-s", 2, 3}, {"-t", 2, 3},
+    {"-type", 5, 1}, {"-texres", 7, 1}, {"-imfchan", 8, 1}, {"-mm", 3, 2},
+    {"-colorspace", 11, 1},
+  };
+
+  bool found = false;
+  while(at < end)
+  {
+    at = obj_skip_space(at, end);
+    const TextureOption* option = 0;
+    for(uint32_t i = 0; i < sizeof(options) / sizeof(options[0]); i++)
+    {
+      if(obj_keyword(at, end, options[i].name, options[i].size))
+      {
+        option = options + i;
+        break;
+      }
+    }
+
+    if(option)
+    {
+      at += option->size;
+      for(uint32_t i = 0; i < option->num_arguments; i++)
+        at = obj_skip_token(obj_skip_space(at, end), end);
+    }
+    else
+    {
+      *name = str_view(at, end - at);
+      found = true;
+      at = end;
+    }
+  }
+  return found;
+}
+
+static void obj_add_material(Array<ObjMaterial>* materials, HashMap<StringView, int32_t>* material_map,
+    ObjMaterial material)
+{
+  // NOTE(ricardo): the first material with a name wins
+  if(!hash_map_get(material_map, material.name))
+    hash_map_put(material_map, material.name, (int32_t)materials->count);
+  array_push(materials, material);
+}
+
+// Only the texture names, nothing else in the .mtl is used by the renderer
+static bool obj_load_mtl(Arena* arena, const char* path, Array<ObjMaterial>* materials,
+    HashMap<StringView, int32_t>* material_map)
+{
+  ReadEntireFile file = read_entire_file(arena, path);
+  if(file.content == 0)
+    return false;
+
+  ObjMaterial material = {};
+  const char* end = file.content + file.size;
+  const char* next = 0;
+  for(const char* at = file.content; at < end; at = next)
+  {
+    const char* line_end = obj_line_end(at, end);
+    next = obj_next_line(line_end, end);
+    while(line_end > at && OBJ_IS_SPACE(line_end[-1]))
+      line_end--;
+
+    const char* token = obj_skip_space(at, line_end);
+    if(token == line_end || *token == '#')
+      continue;
+
+    if(obj_keyword(token, line_end, "newmtl", 6))
+    {
+      if(material.name.size)
+        obj_add_material(materials, material_map, material);
+      material = {};
+      material.name = str_view(token + 7, line_end - token - 7);
+    }
+    else if(obj_keyword(token, line_end, "map_Kd", 6))
+    {
+      obj_texture_name(token + 7, line_end, &material.diffuse_texname);
+    }
+    else if(obj_keyword(token, line_end, "map_Ks", 6))
+    {
+      obj_texture_name(token + 7, line_end, &material.specular_texname);
+    }
+    else if(obj_keyword(token, line_end, "map_bump", 8) || obj_keyword(token, line_end, "map_Bump", 8))
+    {
+      obj_texture_name(token + 9, line_end, &material.bump_texname);
+    }
+    else if(obj_keyword(token, line_end, "bump", 4))
+    {
+      obj_texture_name(token + 5, line_end, &material.bump_texname);
+    }
+  }
+  // The last material always gets added, even without a name
+  obj_add_material(materials, material_map, material);
+  return true;
+}
+
+// mtllib takes a list of files separated by spaces, '\' escapes a character.
+// The first one that loads wins, files that were loaded before are skipped.
+static void obj_load_material_libraries(Arena* arena, Arena* scratch, StringView directory, StringView argument,
+    Array<StringView>* loaded, Array<ObjMaterial>* materials, HashMap<StringView, int32_t>* material_map)
+{
+  bool found = false;
+  uint64_t at = 0;
+  while(at < argument.size)
+  {
+    StringBuilder filename = str_builder_init(scratch, 64);
+    for(; at < argument.size && argument.data[at] != ' '; at++)
+    {
+      if(argument.data[at] == '\\' && ++at == argument.size)
+        break;
+      str_builder_append(&filename, str_view(argument.data + at, 1));
+    }
+    at++;
+
+    StringView name = str_builder_view(&filename);
+    if(name.size == 0)
+      continue;
+
+    bool already_loaded = false;
+    for(uint64_t i = 0; i < loaded->count; i++)
+      already_loaded = already_loaded || str_equal(loaded->data[i], name);
+    if(already_loaded)
+    {
+      found = true;
+      continue;
+    }
+
+    StringView path = name;
+    if(directory.size)
+    {
+      const char* separator = directory.data[directory.size - 1] == '/' ? "" : "/";
+      path = str_push_fmt(scratch, "%.*s%s%.*s", (int)directory.size, directory.data, separator, (int)name.size,
+          name.data);
+    }
+    if(obj_load_mtl(arena, path.data, materials, material_map))
+    {
+      array_push(loaded, name);
+      found = true;
+      break;
+    }
+  }
+
+  if(!found)
+    printf("OBJ: Failed to load material file(s). Use default material.\n");
+}
+
+// Index of the first triangle of a face, one past the last triangle of the
+// chunk for the end
+static uint64_t obj_face_triangle(ObjChunk* chunk, uint64_t face)
+{
+  return face < chunk->faces.count ? chunk->faces.data[face].first_triangle : chunk->triangles.count / 3;
+}
+
+static void obj_push_shape(Arena* arena, Array<ObjShape>* shapes, Array<ObjSegment>* segments, uint64_t num_faces)
+{
+  ObjShape shape = {};
+  shape.num_faces = num_faces;
+  shape.indices = (ObjIndex*)arena_push_no_zero(arena, num_faces * 3 * sizeof(ObjIndex));
+  shape.material_ids = (int32_t*)arena_push_no_zero(arena, num_faces * sizeof(int32_t));
+
+  uint64_t face = 0;
+  for(uint64_t i = 0; i < segments->count; i++)
+  {
+    ObjSegment* segment = segments->data + i;
+    memcpy(shape.indices + face * 3, segment->chunk->triangles.data + segment->first_triangle * 3,
+        segment->num_triangles * 3 * sizeof(ObjIndex));
+    for(uint64_t j = 0; j < segment->num_triangles; j++)
+      shape.material_ids[face + j] = segment->material_id;
+    face += segment->num_triangles;
+  }
+  array_push(shapes, shape);
+  segments->count = 0;
+}
+
+bool obj_parse(Arena* arena, StringView path, StringView mtl_directory, ObjData* result)
+{
+  *result = {};
+  MappedFile file = map_entire_file(path.data);
+  if(file.data == 0 && !get_file_info(path.data).exists)
+  {
+    printf("OBJ: Cannot open file [%s]\n", path.data);
+    return false;
+  }
+
+  TempArena scratch = scratch_begin(&arena, 1);
+
+  // Split at line boundaries, one chunk per worker plus one for this thread.
+  // Small files stay on this thread.
+  uint32_t num_splits = jobs_worker_count() + 1;
+  if(num_splits > OBJ_PARSER_MAX_CHUNKS)
+    num_splits = OBJ_PARSER_MAX_CHUNKS;
+  if(num_splits > file.size / OBJ_PARSER_MIN_CHUNK_SIZE)
+    num_splits = (uint32_t)(file.size / OBJ_PARSER_MIN_CHUNK_SIZE);
+  if(num_splits == 0)
+    num_splits = 1;
+
+  ObjChunk* chunks = (ObjChunk*)arena_push(scratch.arena, num_splits * sizeof(ObjChunk));
+  const char* file_begin = (const char*)file.data;
+  const char* file_end = file_begin + file.size;
+  const char* at = file_begin;
+  uint32_t num_chunks = 0;
+  for(uint32_t i = 0; i < num_splits && (at < file_end || num_chunks == 0); i++)
+  {
+    const char* chunk_end = file_end;
+    if(i + 1 < num_splits)
+    {
+      chunk_end = file_begin + file.size * (i + 1) / num_splits;
+      if(chunk_end < at)
+        chunk_end = at;
+      const char* new_line = (const char*)memchr(chunk_end, '\n', file_end - chunk_end);
+      chunk_end = new_line ? new_line + 1 : file_end;
+    }
+
+    ObjChunk* chunk = chunks + num_chunks++;
+    chunk->begin = at;
+    chunk->end = chunk_end;
+    chunk->data = result;
+    // NOTE(ricardo): only address space, n-gons can triangulate into a lot
+    // more bytes than the text they came from
+    chunk->arena = arena_alloc((chunk_end - at) * 64 + Megabytes(64), "OBJ Chunk", ArenaTag_Scratch);
+    at = chunk_end;
+  }
+
+  obj_run_parallel(chunks, num_chunks, obj_parse_chunk);
+
+  bool ok = true;
+  uint64_t first_line = 0;
+  for(uint32_t i = 0; i < num_chunks; i++)
+  {
+    ObjChunk* chunk = chunks + i;
+    if(chunk->error_line)
+    {
+      printf("OBJ: Failed parse `f' line(e.g. zero value for face index. line %llu.)\n",
+          (unsigned long long)(first_line + chunk->error_line));
+      ok = false;
+      break;
+    }
+    first_line += chunk->num_lines;
+
+    chunk->position_base = result->num_positions;
+    chunk->texcoord_base = result->num_texcoords;
+    chunk->normal_base = result->num_normals;
+    result->num_positions += chunk->positions.count / 3;
+    result->num_texcoords += chunk->texcoords.count / 2;
+    result->num_normals += chunk->normals.count / 3;
+  }
+
+  if(ok)
+  {
+    result->positions = (float*)arena_push_no_zero(arena, result->num_positions * 3 * sizeof(float));
+    result->texcoords = (float*)arena_push_no_zero(arena, result->num_texcoords * 2 * sizeof(float));
+    result->normals = (float*)arena_push_no_zero(arena, result->num_normals * 3 * sizeof(float));
+    obj_run_parallel(chunks, num_chunks, obj_copy_attributes);
+    obj_run_parallel(chunks, num_chunks, obj_triangulate_chunk);
+
+    // Walk the faces in file order and cut them into shapes the way tinyobj
+    // does: g and o start a new shape if the current one has faces, faces
+    // keep the material that was active when they were read
+    Array<ObjMaterial> materials = array_init<ObjMaterial>(scratch.arena, 64);
+    Array<ObjShape> shapes = array_init<ObjShape>(scratch.arena, 64);
+    Array<ObjSegment> segments = array_init<ObjSegment>(scratch.arena, 64);
+    Array<StringView> loaded_libraries = array_init<StringView>(scratch.arena, 4);
+    HashMap<StringView, int32_t> material_map = hash_map_init<StringView, int32_t>(scratch.arena, 64);
+
+    int32_t material_id = -1;
+    uint64_t pending_faces = 0; // Read since the last material change or group
+    uint64_t shape_faces = 0;
+    for(uint32_t i = 0; i < num_chunks; i++)
+    {
+      ObjChunk* chunk = chunks + i;
+      uint64_t face = 0;
+      for(uint64_t c = 0; c <= chunk->commands.count; c++)
+      {
+        ObjCommand* command = c < chunk->commands.count ? chunk->commands.data + c : 0;
+        uint64_t command_face = command ? command->face : chunk->faces.count;
+
+        uint64_t first_triangle = obj_face_triangle(chunk, face);
+        uint64_t end_triangle = obj_face_triangle(chunk, command_face);
+        if(end_triangle > first_triangle)
+        {
+          ObjSegment segment = {chunk, first_triangle, end_triangle - first_triangle, material_id};
+          array_push(&segments, segment);
+          shape_faces += segment.num_triangles;
+        }
+        pending_faces += command_face - face;
+        face = command_face;
+
+        if(command == 0)
+          break;
+
+        if(command->type == ObjCommand_UseMaterial)
+        {
+          int32_t* id = hash_map_get(&material_map, command->argument);
+          if(id == 0)
+          {
+            printf("OBJ: material [ '%.*s' ] not found in .mtl\n", (int)command->argument.size,
+                command->argument.data);
+          }
+          int32_t new_material_id = id ? *id : -1;
+          if(new_material_id != material_id)
+          {
+            pending_faces = 0;
+            material_id = new_material_id;
+          }
+        }
+        else if(command->type == ObjCommand_Group)
+        {
+          if(shape_faces > 0)
+            obj_push_shape(arena, &shapes, &segments, shape_faces);
+          pending_faces = 0;
+          shape_faces = 0;
+        }
+        else if(command->type == ObjCommand_MaterialLibrary)
+        {
+          obj_load_material_libraries(arena, scratch.arena, mtl_directory, command->argument, &loaded_libraries,
+              &materials, &material_map);
+        }
+      }
+    }
+    if(pending_faces > 0 || shape_faces > 0)
+      obj_push_shape(arena, &shapes, &segments, shape_faces);
+
+    result->num_shapes = shapes.count;
+    result->shapes = (ObjShape*)arena_push_no_zero(arena, shapes.count * sizeof(ObjShape));
+    memcpy(result->shapes, shapes.data, shapes.count * sizeof(ObjShape));
+    result->num_materials = (uint32_t)materials.count;
+    result->materials = (ObjMaterial*)arena_push_no_zero(arena, materials.count * sizeof(ObjMaterial));
+    memcpy(result->materials, materials.data, materials.count * sizeof(ObjMaterial));
+  }
+
+  for(uint32_t i = 0; i < num_chunks; i++)
+    arena_release(chunks[i].arena);
+  scratch_end(scratch);
+  unmap_file(&file);
+  return ok;
+}
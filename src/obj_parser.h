@@ -0,0 +1,57 @@
+#pragma once
+#include "memory.h"
+
+// Wavefront OBJ Parser
+// The file is mapped and split at line boundaries, every chunk gets parsed as
+// a job into its own arena. Chunks only know their local v/vt/vn counts, so
+// once all of them are done the attributes get copied into the global arrays
+// and a second parallel pass resolves relative indices and triangulates.
+// Shapes and materials are put together on the calling thread.
+// Output matches tinyobj::ObjReader with triangulation on for the parts we
+// use: v, vt, vn, f, g, o, usemtl and mtllib. Lines, points, tags, smoothing
+// groups and vertex colors are skipped.
+#define OBJ_PARSER_MAX_CHUNKS 64
+#define OBJ_PARSER_MIN_CHUNK_SIZE Megabytes(1)
+
+// -1 if the corner doesn't have that attribute
+struct ObjIndex
+{
+  int32_t vertex_index;
+  int32_t normal_index;
+  int32_t texcoord_index;
+};
+
+// Texture names as written in the .mtl, size 0 if the material has none
+struct ObjMaterial
+{
+  StringView name;
+  StringView diffuse_texname;
+  StringView specular_texname;
+  StringView bump_texname;
+};
+
+// Always triangulated, 3 indices per face
+struct ObjShape
+{
+  ObjIndex* indices;
+  int32_t* material_ids;
+  uint64_t num_faces;
+};
+
+struct ObjData
+{
+  float* positions; // 3 per vertex
+  uint64_t num_positions;
+  float* texcoords; // 2 per vertex
+  uint64_t num_texcoords;
+  float* normals; // 3 per vertex
+  uint64_t num_normals;
+  ObjShape* shapes;
+  uint64_t num_shapes;
+  ObjMaterial* materials;
+  uint32_t num_materials;
+};
+
+// NOTE(ricardo): path must be null terminated. Everything in the result lives
+// in arena. .mtl files are looked up relative to mtl_directory.
+bool obj_parse(Arena* arena, StringView path, StringView mtl_directory, ObjData* result);
@@ -1,17 +1,55 @@
 // #include "opengl_renderer.h"
 #include <iostream>
+#include <condition_variable>
+#include <mutex>
 #include <stdio.h>
+#include <math.h>
 #include <string.h>
+#include <sys/stat.h>
+#ifndef _WIN32
+#include <fcntl.h>
+#endif
 
 #define STB_IMAGE_IMPLEMENTATION
 #include "vendor/stb_image.h"
 
+// Textures get BCn encoded on the workers and cached next to the image as
+// .ctex, 0 uploads the decoded pixels as before
+#define OPENGL_TEXTURE_COMPRESSION 1
+
+// NOTE(ricardo): S3TC is an extension glad didn't generate, every desktop
+// driver has it
+#ifndef GL_COMPRESSED_RGB_S3TC_DXT1_EXT
+#define GL_COMPRESSED_RGB_S3TC_DXT1_EXT 0x83F0
+#endif
+#ifndef GL_COMPRESSED_RGBA_S3TC_DXT5_EXT
+#define GL_COMPRESSED_RGBA_S3TC_DXT5_EXT 0x83F3
+#endif
+
 struct ReadEntireFile
 {
   char* content;
   uint32_t size;
 };
 
+struct FileInfo
+{
+  bool exists;
+  uint64_t size;
+  uint64_t modified_time;
+};
+
+// Read-only view of a whole file, the OS pages it in on demand
+struct MappedFile
+{
+  void* data;
+  uint64_t size;
+#ifdef _WIN32
+  void* file_handle;
+  void* mapping_handle;
+#endif
+};
+
 struct OpenGLProgramCommon
 {
   GLint program_id;
@@ -23,6 +61,10 @@ struct OpenGLProgramCommon
   GLint material_texture_diffuse;
   GLint material_texture_specular;
   GLint material_shininess;
+
+  // Vertex positions are unorm16 inside the mesh bounds
+  GLint position_offset;
+  GLint position_scale;
 };
 
 enum TextureType
@@ -31,6 +73,8 @@ enum TextureType
   specular
 };
 
+struct TextureUpload;
+
 struct Texture
 {
   unsigned int id;
@@ -38,7 +82,9 @@ struct Texture
   int height;
   int nr_channels;
   TextureType type;
-  std::string name;
+  StringView name; // Memory owned by whoever created the texture
+  uint32_t ref_count; // Only used by textures from the registry
+  TextureUpload* upload; // While the image is decoding or waiting for upload
 };
 
 enum DataType
@@ -54,7 +100,10 @@ enum DataType
   Int2,
   Int3,
   Int4,
-  Bool
+  Bool,
+  UShort4,
+  Half2,
+  UInt1010102 // GL_UNSIGNED_INT_2_10_10_10_REV
 };
 
 struct VertexBuffer
@@ -72,8 +121,17 @@ struct IndexBuffer
 {
   unsigned int id;
   unsigned int count;
+  unsigned int type; // GL_UNSIGNED_SHORT or GL_UNSIGNED_INT
 };
 
+// NOTE(ricardo): GPU object handles live in their own pools so they can be
+// destroyed one at a time when assets get unloaded
+#define OPENGL_POOL_RESERVE Megabytes(64)
+static Pool* texture_pool = pool_alloc(sizeof(Texture), OPENGL_POOL_RESERVE, "Texture Pool", ArenaTag_Renderer);
+static Pool* vertex_buffer_pool = pool_alloc(sizeof(VertexBuffer), OPENGL_POOL_RESERVE, "VertexBuffer Pool", ArenaTag_Renderer);
+static Pool* vertex_array_pool = pool_alloc(sizeof(VertexArray), OPENGL_POOL_RESERVE, "VertexArray Pool", ArenaTag_Renderer);
+static Pool* index_buffer_pool = pool_alloc(sizeof(IndexBuffer), OPENGL_POOL_RESERVE, "IndexBuffer Pool", ArenaTag_Renderer);
+
 ReadEntireFile read_entire_file(Arena* arena, const char* file_path)
 {
   ReadEntireFile result = {};
@@ -87,7 +145,7 @@ ReadEntireFile read_entire_file(Arena* arena, const char* file_path)
   result.size = ftell(file_handle);
   fseek(file_handle, 0L, SEEK_SET);
 
-  result.content = (char*)arena_push(arena, result.size+1);
+  result.content = (char*)arena_push_no_zero(arena, result.size+1);
   fread(result.content, 1, result.size, file_handle);
   fclose(file_handle);
   result.content[result.size] = '\0';
@@ -95,6 +153,87 @@ ReadEntireFile read_entire_file(Arena* arena, const char* file_path)
   return result;
 }
 
+FileInfo get_file_info(const char* file_path)
+{
+  FileInfo result = {};
+#ifdef _WIN32
+  struct _stat64 file_stat;
+  if (_stat64(file_path, &file_stat) != 0)
+    return result;
+#else
+  struct stat file_stat;
+  if (stat(file_path, &file_stat) != 0)
+    return result;
+#endif
+  result.exists = true;
+  result.size = file_stat.st_size;
+  result.modified_time = file_stat.st_mtime;
+  return result;
+}
+
+MappedFile map_entire_file(const char* file_path)
+{
+  MappedFile result = {};
+#ifdef _WIN32
+  HANDLE file_handle = CreateFileA(file_path, GENERIC_READ, FILE_SHARE_READ, 0, OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, 0);
+  if (file_handle == INVALID_HANDLE_VALUE)
+    return result;
+  LARGE_INTEGER file_size;
+  GetFileSizeEx(file_handle, &file_size);
+  HANDLE mapping_handle = CreateFileMappingA(file_handle, 0, PAGE_READONLY, 0, 0, 0);
+  if (mapping_handle == 0)
+  {
+    CloseHandle(file_handle);
+    return result;
+  }
+  result.data = MapViewOfFile(mapping_handle, FILE_MAP_READ, 0, 0, 0);
+  result.size = file_size.QuadPart;
+  result.file_handle = file_handle;
+  result.mapping_handle = mapping_handle;
+#else
+  int fd = open(file_path, O_RDONLY);
+  if (fd < 0)
+    return result;
+  struct stat file_stat;
+  if (fstat(fd, &file_stat) == 0 && file_stat.st_size > 0)
+  {
+    void* data = mmap(0, file_stat.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+    if (data != MAP_FAILED)
+    {
+      result.data = data;
+      result.size = file_stat.st_size;
+    }
+  }
+  // NOTE(ricardo): the mapping keeps the file alive on its own
+  close(fd);
+#endif
+  return result;
+}
+
+void unmap_file(MappedFile* file)
+{
+  if (file->data == 0)
+    return;
+#ifdef _WIN32
+  UnmapViewOfFile(file->data);
+  CloseHandle(file->mapping_handle);
+  CloseHandle(file->file_handle);
+#else
+  munmap(file->data, file->size);
+#endif
+  *file = {};
+}
+
+// Zero fills up to the next multiple of align
+bool write_padding(FILE* file, uint64_t* offset, uint64_t align)
+{
+  static const unsigned char zeros[16] = {};
+  uint64_t aligned = align_forward(*offset, align);
+  size_t size = aligned - *offset;
+  *offset = aligned;
+  return size == 0 || fwrite(zeros, 1, size, file) == size;
+}
+
 OpenGLProgramCommon* opengl_create_shader(Arena* arena, char* vertex_shader_source, char* fragment_shader_source)
 {
   OpenGLProgramCommon* program = (OpenGLProgramCommon*)arena_push(arena, sizeof(OpenGLProgramCommon));
@@ -144,42 +283,551 @@ OpenGLProgramCommon* opengl_create_shader(Arena* arena, char* vertex_shader_sour
   program->material_texture_diffuse = glGetUniformLocation(program_id, "material.texture_diffuse");
   program->material_texture_specular = glGetUniformLocation(program_id, "material.texture_specular");
   program->material_shininess = glGetUniformLocation(program_id, "material.shininess");
+  program->position_offset = glGetUniformLocation(program_id, "position_offset");
+  program->position_scale = glGetUniformLocation(program_id, "position_scale");
   return program;
 }
 
-Texture* opengl_create_texture(Arena* arena, const std::string path, TextureType type)
+// Texture Uploads
+// stbi_load, the mip chain and the BCn encoding run on the job workers, the
+// GL thread only copies finished levels into immutable storage. The pool and
+// pending are only touched by the GL thread, workers only hand their upload
+// back through decoded_list.
+struct TextureUpload
+{
+  // Only the GL thread reads it, 0 once the texture got destroyed. Workers
+  // use path and type instead.
+  Texture* texture;
+  StringView path;
+  TextureType type;
+  unsigned char* pixels; // Level 0 when there is no compressed cache
+  Arena* mip_arena; // The rest of the uncompressed chain
+  int width;
+  int height;
+  int nr_channels;
+
+  MappedFile cache; // Compressed levels point into it when they come from the .ctex
+  bool compressed; // levels hold format blocks instead of pixels
+  TextureFormat format;
+  uint32_t num_levels;
+  TextureLevel levels[TEXTURE_MAX_LEVELS];
+  TextureUpload* next;
+};
+
+struct TextureUploadQueue
+{
+  std::mutex mutex;
+  std::condition_variable decoded;
+  TextureUpload* decoded_list; // Guarded by mutex
+  uint32_t pending; // Decoding or waiting for upload
+};
+
+static Pool* texture_upload_pool = pool_alloc(sizeof(TextureUpload), OPENGL_POOL_RESERVE, "TextureUpload Pool", ArenaTag_Renderer);
+static TextureUploadQueue texture_uploads;
+
+// Compressed Texture Cache (.ctex)
+// Written next to the image: header, level table and then the blocks of every
+// level (16 byte aligned) exactly as glCompressedTexImage2D takes them.
+// Bump CTEX_VERSION whenever the encoder or the format choice changes.
+#define CTEX_MAGIC 0x58455443 // "CTEX"
+#define CTEX_VERSION 2
+
+struct CTexHeader
+{
+  uint32_t magic;
+  uint32_t version;
+  uint32_t format;
+  uint32_t num_levels;
+  int32_t width;
+  int32_t height;
+  int32_t channels;
+  uint32_t padding;
+  uint64_t source_size;
+  uint64_t source_modified_time;
+};
+
+struct CTexLevel
+{
+  uint64_t offset;
+  uint64_t size;
+};
+
+static bool ctex_range_valid(MappedFile* file, uint64_t offset, uint64_t size)
+{
+  return offset <= file->size && size <= file->size - offset;
+}
+
+static bool texture_load_cache(TextureUpload* upload, const char* cache_path, FileInfo source_info)
 {
-  Texture* texture = (Texture*)arena_push(arena, sizeof(Texture));
+  MappedFile file = map_entire_file(cache_path);
+  if (file.data == 0)
+    return false;
+
+  unsigned char* base = (unsigned char*)file.data;
+  CTexHeader* header = (CTexHeader*)base;
+  bool valid = file.size >= sizeof(CTexHeader) && header->magic == CTEX_MAGIC && header->version == CTEX_VERSION &&
+    header->format < TextureFormat_Count && header->width > 0 && header->height > 0 && header->channels >= 1 &&
+    header->channels <= 4 && header->num_levels == texture_level_count(header->width, header->height);
+  // Same as the mesh cache, no source is fine but a stale cache is not
+  if (valid && source_info.exists)
+  {
+    valid = header->source_size == source_info.size && header->source_modified_time == source_info.modified_time;
+  }
+  valid = valid && ctex_range_valid(&file, sizeof(CTexHeader), header->num_levels * sizeof(CTexLevel));
+  if (!valid)
+  {
+    unmap_file(&file);
+    return false;
+  }
+
+  // NOTE(ricardo): levels only get copied once everything checked out, a
+  // failed load leaves the uncompressed chain in upload alone
+  CTexLevel* cache_levels = (CTexLevel*)(base + sizeof(CTexHeader));
+  TextureLevel levels[TEXTURE_MAX_LEVELS];
+  TextureFormat format = (TextureFormat)header->format;
+  int width = header->width;
+  int height = header->height;
+  for (uint32_t i = 0; i < header->num_levels; i++)
+  {
+    CTexLevel* cache_level = cache_levels + i;
+    if (cache_level->size != texture_compressed_size(format, width, height) ||
+        !ctex_range_valid(&file, cache_level->offset, cache_level->size))
+    {
+      unmap_file(&file);
+      return false;
+    }
+    levels[i].data = base + cache_level->offset;
+    levels[i].size = cache_level->size;
+    levels[i].width = width;
+    levels[i].height = height;
+    width = width > 1 ? width / 2 : 1;
+    height = height > 1 ? height / 2 : 1;
+  }
+
+  memcpy(upload->levels, levels, header->num_levels * sizeof(TextureLevel));
+  upload->cache = file;
+  upload->compressed = true;
+  upload->format = format;
+  upload->num_levels = header->num_levels;
+  upload->width = header->width;
+  upload->height = header->height;
+  upload->nr_channels = header->channels;
+  return true;
+}
+
+// NOTE(ricardo): picked by what the shaders read. Diffuse alpha is used for
+// cutouts so it only survives as BC3, specular only reads rgb. One channel
+// images used to be GL_RED and BC4 keeps it that way.
+static TextureFormat texture_choose_format(TextureType type, const unsigned char* pixels, uint64_t num_pixels,
+    int channels)
+{
+  if (channels == 1)
+    return TextureFormat_BC4;
+  if (channels == 2)
+    return TextureFormat_BC5;
+  if (channels == 4 && type == diffuse)
+  {
+    for (uint64_t i = 0; i < num_pixels; i++)
+    {
+      if (pixels[i * 4 + 3] != 255)
+        return TextureFormat_BC3;
+    }
+  }
+  return TextureFormat_BC1;
+}
+
+// Uncompressed mip chain for upload->pixels. Diffuse textures are color and
+// get filtered in linear space, everything else is data.
+static void texture_build_mips(TextureUpload* upload)
+{
+  int channels = upload->nr_channels;
+  uint32_t num_levels = texture_level_count(upload->width, upload->height);
+  uint64_t chain_size = 0;
+  int width = upload->width;
+  int height = upload->height;
+  for (uint32_t i = 0; i < num_levels; i++)
+  {
+    upload->levels[i].size = (uint64_t)width * height * channels;
+    upload->levels[i].width = width;
+    upload->levels[i].height = height;
+    if (i > 0)
+      chain_size += upload->levels[i].size;
+#if OPENGL_TEXTURE_COMPRESSION
+    // texture_compress_upload puts the blocks in here too, 16 bytes is the
+    // biggest block of any format
+    chain_size += align_forward(texture_compressed_size(TextureFormat_BC3, width, height), 16);
+#endif
+    width = width > 1 ? width / 2 : 1;
+    height = height > 1 ? height / 2 : 1;
+  }
+
+  // Room for the job bands on top of the pixels
+  upload->mip_arena = arena_alloc(chain_size + Megabytes(1), "Texture Mips", ArenaTag_Renderer);
+  upload->levels[0].data = upload->pixels;
+  for (uint32_t i = 1; i < num_levels; i++)
+    upload->levels[i].data = (uint8_t*)arena_push_no_zero(upload->mip_arena, upload->levels[i].size);
+  upload->num_levels = num_levels;
+  texture_generate_mips(upload->mip_arena, upload->levels, num_levels, channels, upload->type == diffuse);
+}
+
+static void texture_free_pixels(TextureUpload* upload)
+{
+  stbi_image_free(upload->pixels);
+  upload->pixels = 0;
+  if (upload->mip_arena)
+    arena_release(upload->mip_arena);
+  upload->mip_arena = 0;
+}
+
+// Encodes the uncompressed chain in upload into blocks that live in its
+// mip arena, the pixels aren't needed after that
+static void texture_compress_upload(TextureUpload* upload)
+{
+  TempArena scratch = scratch_begin(&upload->mip_arena, 1);
+  int channels = upload->nr_channels;
+  TextureFormat format = texture_choose_format(upload->type, upload->pixels,
+      (uint64_t)upload->width * upload->height, channels);
+  uint32_t num_levels = upload->num_levels;
+
+  uint8_t* level_pixels[TEXTURE_MAX_LEVELS];
+  for (uint32_t i = 0; i < num_levels; i++)
+  {
+    TextureLevel* level = upload->levels + i;
+    level_pixels[i] = level->data;
+    level->size = texture_compressed_size(format, level->width, level->height);
+    level->data = (uint8_t*)arena_push_align_no_zero(upload->mip_arena, level->size, 16);
+  }
+  texture_compress_levels(scratch.arena, format, level_pixels, channels, upload->levels, num_levels);
+  scratch_end(scratch);
+
+  upload->compressed = true;
+  upload->format = format;
+  stbi_image_free(upload->pixels);
+  upload->pixels = 0;
+}
+
+// Writes the compressed levels in upload, failing only costs the encode again
+// on the next run
+static bool texture_write_cache(TextureUpload* upload, StringView cache_path, FileInfo source_info)
+{
+  TempArena scratch = scratch_begin(0, 0);
+  uint32_t num_levels = upload->num_levels;
+  CTexLevel cache_levels[TEXTURE_MAX_LEVELS];
+  uint64_t offset = sizeof(CTexHeader) + num_levels * sizeof(CTexLevel);
+  for (uint32_t i = 0; i < num_levels; i++)
+  {
+    offset = align_forward(offset, 16);
+    cache_levels[i].offset = offset;
+    cache_levels[i].size = upload->levels[i].size;
+    offset += upload->levels[i].size;
+  }
+
+  CTexHeader header = {};
+  header.magic = CTEX_MAGIC;
+  header.version = CTEX_VERSION;
+  header.format = upload->format;
+  header.num_levels = num_levels;
+  header.width = upload->width;
+  header.height = upload->height;
+  header.channels = upload->nr_channels;
+  header.source_size = source_info.size;
+  header.source_modified_time = source_info.modified_time;
+
+  // Temporary file and rename, same as the mesh cache
+  StringView temp_path = str_push_concat(scratch.arena, cache_path, str_view(".tmp"));
+  FILE* file = fopen(temp_path.data, "wb");
+  if (file == 0)
+  {
+    printf("Failed to write texture cache %s\n", temp_path.data);
+    scratch_end(scratch);
+    return false;
+  }
+
+  bool ok = fwrite(&header, sizeof(header), 1, file) == 1;
+  ok = ok && fwrite(cache_levels, sizeof(CTexLevel), num_levels, file) == num_levels;
+  offset = sizeof(CTexHeader) + num_levels * sizeof(CTexLevel);
+  for (uint32_t i = 0; ok && i < num_levels; i++)
+  {
+    TextureLevel* level = upload->levels + i;
+    ok = ok && write_padding(file, &offset, 16);
+    ok = ok && fwrite(level->data, 1, level->size, file) == level->size;
+    offset += level->size;
+  }
+  ok = fclose(file) == 0 && ok;
+
+#ifdef _WIN32
+  remove(cache_path.data);
+#endif
+  if (!ok || rename(temp_path.data, cache_path.data) != 0)
+  {
+    printf("Failed to write texture cache %s\n", cache_path.data);
+    remove(temp_path.data);
+    ok = false;
+  }
+  scratch_end(scratch);
+  return ok;
+}
+
+static void texture_decode_job(void* data)
+{
+  TextureUpload* upload = (TextureUpload*)data;
+  const char* path = upload->path.data;
+#if OPENGL_TEXTURE_COMPRESSION
+  // NOTE(ricardo): with a valid cache the image never gets decoded at all
+  TempArena scratch = scratch_begin(0, 0);
+  StringView cache_path = str_push_concat(scratch.arena, upload->path, str_view(".ctex"));
+  FileInfo source_info = get_file_info(path);
+  if (!texture_load_cache(upload, cache_path.data, source_info))
+  {
+    upload->pixels = stbi_load(path, &upload->width, &upload->height, &upload->nr_channels, 0);
+    if (upload->pixels != nullptr)
+    {
+      // The blocks get uploaded straight from memory, the cache is only for
+      // the next run
+      texture_build_mips(upload);
+      texture_compress_upload(upload);
+      texture_write_cache(upload, cache_path, source_info);
+    }
+  }
+  scratch_end(scratch);
+#else
+  upload->pixels = stbi_load(path, &upload->width, &upload->height, &upload->nr_channels, 0);
+  if (upload->pixels != nullptr)
+    texture_build_mips(upload);
+#endif
+  if (upload->pixels == nullptr && !upload->compressed)
+    printf("Failed to load texture(%s) reason: %s", path, stbi_failure_reason());
+
+  {
+    std::lock_guard<std::mutex> lock(texture_uploads.mutex);
+    upload->next = texture_uploads.decoded_list;
+    texture_uploads.decoded_list = upload;
+  }
+  texture_uploads.decoded.notify_one();
+}
+
+// NOTE(ricardo): path has to be null terminated and stay alive until the
+// decode is done, even when the texture gets destroyed before that. The image
+// gets filled in by opengl_upload_textures.
+// Until then it is a 1x1 placeholder so it can be drawn right away: mid grey
+// for diffuse and black (no highlights) for specular.
+Texture* opengl_create_texture(StringView path, TextureType type)
+{
+  Texture* texture = POOL_PUSH(texture_pool, Texture);
   texture->name = path;
+  texture->type = type;
+  texture->width = 1;
+  texture->height = 1;
+  texture->nr_channels = 4;
+  static const unsigned char placeholders[2][4] = {{128, 128, 128, 255}, {0, 0, 0, 255}};
   glGenTextures(1, &texture->id);
   glBindTexture(GL_TEXTURE_2D, texture->id);
   glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_REPEAT);
   glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_REPEAT);
-  glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
+  glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR_MIPMAP_LINEAR);
   glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+  // Mutable, glTexStorage2D can still replace it later
+  glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAX_LEVEL, 0);
+  glTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA8, 1, 1, 0, GL_RGBA, GL_UNSIGNED_BYTE, placeholders[type]);
+  glBindTexture(GL_TEXTURE_2D, 0);
+
+  TextureUpload* upload = POOL_PUSH(texture_upload_pool, TextureUpload);
+  upload->texture = texture;
+  upload->path = path;
+  upload->type = type;
+  texture->upload = upload;
+  texture_uploads.pending++;
+  job_push(texture_decode_job, upload, 0);
+  return texture;
+}
+
+static GLenum opengl_compressed_format(TextureFormat format)
+{
+  switch (format)
+  {
+    case TextureFormat_BC1:
+      return GL_COMPRESSED_RGB_S3TC_DXT1_EXT;
+    case TextureFormat_BC3:
+      return GL_COMPRESSED_RGBA_S3TC_DXT5_EXT;
+    case TextureFormat_BC4:
+      return GL_COMPRESSED_RED_RGTC1;
+    case TextureFormat_BC5:
+      return GL_COMPRESSED_RG_RGTC2;
+    default:
+      return 0;
+  }
+}
 
-  unsigned char* data = stbi_load(path.c_str(), &texture->width, &texture->height, &texture->nr_channels, 0);
-  if (data != nullptr)
+// NOTE(ricardo): glTexStorage2D is 4.2, the 4.1 context we ask for (macOS)
+// falls back to specifying every level by hand
+static void opengl_upload_texture(TextureUpload* upload)
+{
+  Texture* texture = upload->texture;
+  bool immutable = GLAD_GL_VERSION_4_2;
+  if (texture == 0)
   {
-    int format = GL_RGB;
-    if (texture->nr_channels == 1)
-      format = GL_RED;
-    else if (texture->nr_channels == 3)
-      format = GL_RGB;
-    else if (texture->nr_channels == 4)
-      format = GL_RGBA;
-
-    glTexImage2D(GL_TEXTURE_2D, 0, format, texture->width, texture->height, 0, format, GL_UNSIGNED_BYTE, data);
-    glGenerateMipmap(GL_TEXTURE_2D);
+    // Destroyed while it was decoding
+    unmap_file(&upload->cache);
+  }
+  else if (upload->compressed || upload->pixels != nullptr)
+  {
+    texture->width = upload->width;
+    texture->height = upload->height;
+    texture->nr_channels = upload->nr_channels;
+    glBindTexture(GL_TEXTURE_2D, texture->id);
+    // The placeholder only had one level
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAX_LEVEL, upload->num_levels - 1);
+  }
+
+  if (texture && upload->compressed)
+  {
+    GLenum format = opengl_compressed_format(upload->format);
+    if (immutable)
+      glTexStorage2D(GL_TEXTURE_2D, upload->num_levels, format, upload->width, upload->height);
+    for (uint32_t i = 0; i < upload->num_levels; i++)
+    {
+      TextureLevel* level = upload->levels + i;
+      if (immutable)
+        glCompressedTexSubImage2D(GL_TEXTURE_2D, i, 0, 0, level->width, level->height, format, (GLsizei)level->size,
+            level->data);
+      else
+        glCompressedTexImage2D(GL_TEXTURE_2D, i, format, level->width, level->height, 0, (GLsizei)level->size,
+            level->data);
+    }
     glBindTexture(GL_TEXTURE_2D, 0);
-    texture->type = type;
+    unmap_file(&upload->cache);
   }
-  else
+  else if (texture && upload->pixels != nullptr)
   {
-    printf("Failed to load texture(%s) reason: %s", path.c_str(), stbi_failure_reason());
+    static const GLenum formats[4] = {GL_RED, GL_RG, GL_RGB, GL_RGBA};
+    static const GLenum internal_formats[4] = {GL_R8, GL_RG8, GL_RGB8, GL_RGBA8};
+    GLenum format = formats[texture->nr_channels - 1];
+    GLenum internal_format = internal_formats[texture->nr_channels - 1];
+
+    // Small levels of RGB images have rows that aren't 4 byte aligned
+    glPixelStorei(GL_UNPACK_ALIGNMENT, 1);
+    if (immutable)
+      glTexStorage2D(GL_TEXTURE_2D, upload->num_levels, internal_format, upload->width, upload->height);
+    for (uint32_t i = 0; i < upload->num_levels; i++)
+    {
+      TextureLevel* level = upload->levels + i;
+      if (immutable)
+        glTexSubImage2D(GL_TEXTURE_2D, i, 0, 0, level->width, level->height, format, GL_UNSIGNED_BYTE, level->data);
+      else
+        glTexImage2D(GL_TEXTURE_2D, i, internal_format, level->width, level->height, 0, format, GL_UNSIGNED_BYTE,
+            level->data);
+    }
+    glPixelStorei(GL_UNPACK_ALIGNMENT, 4);
+    glBindTexture(GL_TEXTURE_2D, 0);
   }
-  stbi_image_free(data);
-  return texture;
+  if (texture)
+    texture->upload = 0;
+  texture_free_pixels(upload);
+  pool_free(texture_upload_pool, upload);
+  texture_uploads.pending--;
+}
+
+// Uploads whatever finished decoding, never blocks. Stops once budget_seconds
+// are used up but always uploads at least one texture, the rest waits for the
+// next call.
+uint32_t opengl_upload_textures(double budget_seconds)
+{
+  TextureUpload* upload;
+  {
+    std::lock_guard<std::mutex> lock(texture_uploads.mutex);
+    upload = texture_uploads.decoded_list;
+    texture_uploads.decoded_list = 0;
+  }
+
+  double deadline = glfwGetTime() + budget_seconds;
+  uint32_t count = 0;
+  while (upload)
+  {
+    TextureUpload* next = upload->next;
+    opengl_upload_texture(upload);
+    upload = next;
+    count++;
+    if (upload && glfwGetTime() >= deadline)
+      break;
+  }
+
+  if (upload)
+  {
+    TextureUpload* last = upload;
+    while (last->next)
+      last = last->next;
+    std::lock_guard<std::mutex> lock(texture_uploads.mutex);
+    last->next = texture_uploads.decoded_list;
+    texture_uploads.decoded_list = upload;
+  }
+  return count;
+}
+
+// Blocks until every texture created so far is uploaded, helping with the
+// decoding while it waits
+void opengl_finish_texture_uploads()
+{
+  while (texture_uploads.pending > 0)
+  {
+    if (opengl_upload_textures(HUGE_VAL) > 0 || job_run_one())
+      continue;
+
+    std::unique_lock<std::mutex> lock(texture_uploads.mutex);
+    texture_uploads.decoded.wait(lock, [] { return texture_uploads.decoded_list != 0; });
+  }
+}
+
+void opengl_destroy_texture(Texture* texture)
+{
+  // NOTE(ricardo): a decode in flight keeps going, the upload just gets
+  // dropped once it is decoded
+  if (texture->upload)
+    texture->upload->texture = 0;
+  glDeleteTextures(1, &texture->id);
+  pool_free(texture_pool, texture);
+}
+
+// Texture Registry
+// Interns textures by normalized path so materials sharing an image share one
+// decode and one GL texture. Entries are never removed from the map, a
+// released texture just leaves its slot empty and keeps the interned name
+// around for the next acquire.
+struct TextureRegistryEntry
+{
+  StringView name; // Normalized and null terminated, lives in the registry arena
+  Texture* texture;
+};
+
+static Arena* texture_registry_arena = arena_alloc(OPENGL_POOL_RESERVE, "Texture Registry", ArenaTag_Renderer);
+static HashMap<StringView, TextureRegistryEntry> texture_registry =
+    hash_map_init<StringView, TextureRegistryEntry>(texture_registry_arena, 256);
+
+Texture* opengl_acquire_texture(StringView path, TextureType type)
+{
+  TempArena scratch = scratch_begin(0, 0);
+  StringView name = str_push_normalized_path(scratch.arena, path);
+  TextureRegistryEntry* entry = hash_map_get(&texture_registry, name);
+  if (entry == 0)
+  {
+    TextureRegistryEntry new_entry = {};
+    new_entry.name = str_push_copy(texture_registry_arena, name);
+    entry = hash_map_put(&texture_registry, new_entry.name, new_entry);
+  }
+  scratch_end(scratch);
+
+  if (entry->texture == 0)
+    entry->texture = opengl_create_texture(entry->name, type);
+  entry->texture->ref_count++;
+  return entry->texture;
+}
+
+void opengl_release_texture(Texture* texture)
+{
+  if (--texture->ref_count > 0)
+    return;
+  TextureRegistryEntry* entry = hash_map_get(&texture_registry, texture->name);
+  entry->texture = 0;
+  opengl_destroy_texture(texture);
 }
 
 void opengl_bind_texture(unsigned int id, unsigned int slot)
@@ -211,6 +859,12 @@ static GLenum shader_data_type_to_open_gl_base_type(DataType type)
       return GL_INT;
     case DataType::Bool:
       return GL_BOOL;
+    case DataType::UShort4:
+      return GL_UNSIGNED_SHORT;
+    case DataType::Half2:
+      return GL_HALF_FLOAT;
+    case DataType::UInt1010102:
+      return GL_UNSIGNED_INT_2_10_10_10_REV;
     case DataType::None:
       break;
   }
@@ -243,6 +897,12 @@ static uint32_t data_type_size(DataType type)
       return 4 * 4;
     case DataType::Bool:
       return 1;
+    case DataType::UShort4:
+      return 2 * 4;
+    case DataType::Half2:
+      return 2 * 2;
+    case DataType::UInt1010102:
+      return 4;
     case DataType::None:
       return 0;
   }
@@ -276,19 +936,31 @@ static uint32_t get_component_count(DataType type)
       return 4;
     case DataType::Bool:
       return 1;
+    case DataType::UShort4:
+      return 4;
+    case DataType::Half2:
+      return 2;
+    case DataType::UInt1010102:
+      return 4;
     case DataType::None:
       return 0;
   }
   return 0;
 }
 
-VertexArray* opengl_create_vertex_array(Arena* arena)
+VertexArray* opengl_create_vertex_array()
 {
-  VertexArray* vertex_array = (VertexArray*)arena_push(arena, sizeof(VertexArray));
+  VertexArray* vertex_array = POOL_PUSH(vertex_array_pool, VertexArray);
   glGenVertexArrays(1, &vertex_array->id);
   return vertex_array;
 }
 
+void opengl_destroy_vertex_array(VertexArray* vertex_array)
+{
+  glDeleteVertexArrays(1, &vertex_array->id);
+  pool_free(vertex_array_pool, vertex_array);
+}
+
 void opengl_add_element_to_layout(DataType type, bool normalized, int* enabled_attribs, int stride, int* offset,
     VertexArray* vertex_array, VertexBuffer* buffer)
 {
@@ -303,9 +975,9 @@ void opengl_add_element_to_layout(DataType type, bool normalized, int* enabled_a
   glBindBuffer(GL_ARRAY_BUFFER, 0);
 }
 
-VertexBuffer* opengl_create_vertex_buffer(Arena* arena, const void* data, size_t size)
+VertexBuffer* opengl_create_vertex_buffer(const void* data, size_t size)
 {
-  VertexBuffer* vertex_buffer = (VertexBuffer*)arena_push(arena, sizeof(VertexBuffer));
+  VertexBuffer* vertex_buffer = POOL_PUSH(vertex_buffer_pool, VertexBuffer);
   glGenBuffers(1, &vertex_buffer->id);
   glBindBuffer(GL_ARRAY_BUFFER, vertex_buffer->id);
   glBufferData(GL_ARRAY_BUFFER, size, data, GL_STATIC_DRAW);
@@ -313,12 +985,60 @@ VertexBuffer* opengl_create_vertex_buffer(Arena* arena, const void* data, size_t
   return vertex_buffer;
 }
 
-IndexBuffer* opengl_create_index_buffer(Arena* arena, const void* indices, unsigned int count)
+void opengl_destroy_vertex_buffer(VertexBuffer* vertex_buffer)
+{
+  glDeleteBuffers(1, &vertex_buffer->id);
+  pool_free(vertex_buffer_pool, vertex_buffer);
+}
+
+void opengl_upload_vertex_buffer(VertexBuffer* vertex_buffer, size_t offset, const void* data, size_t size)
+{
+  glBindBuffer(GL_ARRAY_BUFFER, vertex_buffer->id);
+  glBufferSubData(GL_ARRAY_BUFFER, (GLintptr)offset, (GLsizeiptr)size, data);
+  glBindBuffer(GL_ARRAY_BUFFER, 0);
+}
+
+IndexBuffer* opengl_create_index_buffer(const void* indices, unsigned int count, unsigned int index_size)
 {
-  IndexBuffer* index_buffer = (IndexBuffer*)arena_push(arena, sizeof(IndexBuffer));
+  IndexBuffer* index_buffer = POOL_PUSH(index_buffer_pool, IndexBuffer);
+  index_buffer->count = count;
+  index_buffer->type = index_size == 2 ? GL_UNSIGNED_SHORT : GL_UNSIGNED_INT;
   glGenBuffers(1, &index_buffer->id);
   glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, index_buffer->id);
-  glBufferData(GL_ELEMENT_ARRAY_BUFFER, (GLsizeiptr)count * sizeof(unsigned int), indices, GL_STATIC_DRAW);
+  glBufferData(GL_ELEMENT_ARRAY_BUFFER, (GLsizeiptr)count * index_size, indices, GL_STATIC_DRAW);
   glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, 0);
   return index_buffer;
 }
+
+void opengl_destroy_index_buffer(IndexBuffer* index_buffer)
+{
+  glDeleteBuffers(1, &index_buffer->id);
+  pool_free(index_buffer_pool, index_buffer);
+}
+
+void opengl_upload_index_buffer(IndexBuffer* index_buffer, size_t offset, const void* data, size_t size)
+{
+  // NOTE(ricardo): goes through the copy target so binding it doesn't change
+  // the element buffer of whatever VAO is bound
+  glBindBuffer(GL_COPY_WRITE_BUFFER, index_buffer->id);
+  glBufferSubData(GL_COPY_WRITE_BUFFER, (GLintptr)offset, (GLsizeiptr)size, data);
+  glBindBuffer(GL_COPY_WRITE_BUFFER, 0);
+}
+
+// The element buffer binding is part of the VAO
+void opengl_set_index_buffer(VertexArray* vertex_array, IndexBuffer* index_buffer)
+{
+  glBindVertexArray(vertex_array->id);
+  glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, index_buffer->id);
+  glBindVertexArray(0);
+}
+
+// Used to grow buffers, both are buffer ids
+void opengl_copy_buffer(unsigned int source, unsigned int destination, size_t size)
+{
+  glBindBuffer(GL_COPY_READ_BUFFER, source);
+  glBindBuffer(GL_COPY_WRITE_BUFFER, destination);
+  glCopyBufferSubData(GL_COPY_READ_BUFFER, GL_COPY_WRITE_BUFFER, 0, 0, (GLsizeiptr)size);
+  glBindBuffer(GL_COPY_READ_BUFFER, 0);
+  glBindBuffer(GL_COPY_WRITE_BUFFER, 0);
+}
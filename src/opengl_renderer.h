@@ -1,8 +1,9 @@
 #pragma once
 #include <glad/gl.h>
 #include "memory.h"
-
-#include <string>
+#include "jobs.h"
+#include "texture_compress.h"
+#include <stdio.h>
 
 struct ReadEntireFile
 {
@@ -12,6 +13,30 @@ struct ReadEntireFile
 
 ReadEntireFile read_entire_file(Arena* arena, const char* file_path);
 
+struct FileInfo
+{
+  bool exists;
+  uint64_t size;
+  uint64_t modified_time;
+};
+
+// Read-only view of a whole file, the OS pages it in on demand
+struct MappedFile
+{
+  void* data;
+  uint64_t size;
+#ifdef _WIN32
+  void* file_handle;
+  void* mapping_handle;
+#endif
+};
+
+FileInfo get_file_info(const char* file_path);
+MappedFile map_entire_file(const char* file_path);
+void unmap_file(MappedFile* file);
+// Zero fills up to the next multiple of align
+bool write_padding(FILE* file, uint64_t* offset, uint64_t align);
+
 struct OpenGLProgramCommon
 {
   GLint program_id;
@@ -23,6 +48,10 @@ struct OpenGLProgramCommon
   GLint material_texture_diffuse;
   GLint material_texture_specular;
   GLint material_shininess;
+
+  // Vertex positions are unorm16 inside the mesh bounds
+  GLint position_offset;
+  GLint position_scale;
 };
 
 OpenGLProgramCommon* opengl_create_shader(Arena* arena, char* vertex_shader_source, char* fragment_shader_source);
@@ -33,6 +62,8 @@ enum TextureType
   specular
 };
 
+struct TextureUpload;
+
 struct Texture
 {
   unsigned int id;
@@ -40,10 +71,23 @@ struct Texture
   int height;
   int nr_channels;
   TextureType type;
-  std::string name;
+  StringView name; // Memory owned by whoever created the texture
+  uint32_t ref_count; // Only used by textures from the registry
+  TextureUpload* upload; // While the image is decoding or waiting for upload
 };
 
-Texture* opengl_create_texture(Arena* arena, const std::string path, TextureType type);
+// Decoding and BCn encoding happen on the job workers (or come straight from
+// the .ctex next to the image), the texture is a 1x1 placeholder until
+// opengl_upload_textures or opengl_finish_texture_uploads picks it up
+Texture* opengl_create_texture(StringView path, TextureType type);
+// At least one texture per call, more while budget_seconds allow
+uint32_t opengl_upload_textures(double budget_seconds);
+void opengl_finish_texture_uploads();
+void opengl_destroy_texture(Texture* texture);
+// Shared textures by path, '\\' and "./" differences don't create duplicates.
+// The first acquire creates it, the last release destroys it.
+Texture* opengl_acquire_texture(StringView path, TextureType type);
+void opengl_release_texture(Texture* texture);
 void opengl_bind_texture(unsigned int id, unsigned int slot);
 void opengl_unbind_texture();
 
@@ -60,7 +104,10 @@ enum DataType
   Int2,
   Int3,
   Int4,
-  Bool
+  Bool,
+  UShort4,
+  Half2,
+  UInt1010102 // GL_UNSIGNED_INT_2_10_10_10_REV
 };
 
 struct VertexBuffer
@@ -68,7 +115,9 @@ struct VertexBuffer
   unsigned int id;
 };
 
-VertexBuffer* opengl_create_vertex_buffer(Arena* arena, const void* data, size_t size);
+VertexBuffer* opengl_create_vertex_buffer(const void* data, size_t size);
+void opengl_destroy_vertex_buffer(VertexBuffer* vertex_buffer);
+void opengl_upload_vertex_buffer(VertexBuffer* vertex_buffer, size_t offset, const void* data, size_t size);
 
 struct VertexArray
 {
@@ -76,7 +125,8 @@ struct VertexArray
   unsigned int enabled_attribs;
 };
 
-VertexArray* opengl_create_vertex_array(Arena* arena);
+VertexArray* opengl_create_vertex_array();
+void opengl_destroy_vertex_array(VertexArray* vertex_array);
 void opengl_add_element_to_layout(DataType type, bool normalized, int* enabled_attribs, int stride, int* offset,
     VertexArray* vertex_array, VertexBuffer* buffer);
 
@@ -84,6 +134,12 @@ struct IndexBuffer
 {
   unsigned int id;
   unsigned int count;
+  unsigned int type; // GL_UNSIGNED_SHORT or GL_UNSIGNED_INT
 };
 
-IndexBuffer* opengl_create_index_buffer(Arena* arena, const void* indices, unsigned int count);
+// index_size is 2 or 4 bytes
+IndexBuffer* opengl_create_index_buffer(const void* indices, unsigned int count, unsigned int index_size);
+void opengl_destroy_index_buffer(IndexBuffer* index_buffer);
+void opengl_upload_index_buffer(IndexBuffer* index_buffer, size_t offset, const void* data, size_t size);
+void opengl_set_index_buffer(VertexArray* vertex_array, IndexBuffer* index_buffer);
+void opengl_copy_buffer(unsigned int source, unsigned int destination, size_t size);
@@ -20,6 +20,9 @@ struct SponzaShader
 
 static Camera* camera = nullptr;
 static Camera* second_camera = nullptr;
+// How far a LOD may be off on screen before the next finer one gets drawn
+static float lod_pixel_error = 1.0f;
+static bool meshlet_culling = true;
 
 static void mouse_callback(GLFWwindow* /*window*/, double xpos, double ypos)
 {
@@ -51,23 +54,29 @@ struct Sponza
   unsigned int texture_colorbuffer;
 };
 
-static Arena* arena = arena_alloc(Megabytes(30));
+// NOTE(ricardo): shaders and cameras, the models stream into arenas of their own
+static Arena* arena = arena_alloc(Megabytes(64), "Sponza", ArenaTag_Assets);
+// Upload time per frame while the models stream in
+#define SPONZA_STREAM_BUDGET 0.002
+static bool metrics_collected = false;
 
 Sponza* sponza = (Sponza*)new Sponza;
 
 void init()
 {
-  Arena* temp = arena_alloc(Megabytes(10));
-  std::string base_path_assets = "./data/";
+  TempArena scratch = scratch_begin(&arena, 1);
+  Arena* temp = scratch.arena;
+  StringView base_path_assets = str_view("./data/");
 
-  sponza->sponza = create_model(arena, base_path_assets + "sponza/sponza.obj");
-  sponza->light = create_model(arena, base_path_assets + "cube/cube.obj");
+  // The first frames draw whatever made it to the GPU so far
+  sponza->sponza = create_model_async(str_push_concat(temp, base_path_assets, str_view("sponza/sponza.obj")));
+  sponza->light = create_model_async(str_push_concat(temp, base_path_assets, str_view("cube/cube.obj")));
 
   // Sponza
-  std::string vertex_shader_path = base_path_assets + "shaders/basic.vert";
-  std::string fragment_shader_path = base_path_assets + "shaders/basic.frag";
-  ReadEntireFile vertex_shader_source = read_entire_file(temp, vertex_shader_path.c_str());
-  ReadEntireFile fragment_shader_source = read_entire_file(temp, fragment_shader_path.c_str());
+  StringView vertex_shader_path = str_push_concat(temp, base_path_assets, str_view("shaders/basic.vert"));
+  StringView fragment_shader_path = str_push_concat(temp, base_path_assets, str_view("shaders/basic.frag"));
+  ReadEntireFile vertex_shader_source = read_entire_file(temp, vertex_shader_path.data);
+  ReadEntireFile fragment_shader_source = read_entire_file(temp, fragment_shader_path.data);
 
   sponza->shader = (SponzaShader*)opengl_create_shader(arena, vertex_shader_source.content, fragment_shader_source.content);
   SponzaShader* shader = sponza->shader;
@@ -82,10 +91,10 @@ void init()
   SHADER_PUSH_GET_UNIFORM(shader->light_quadratic, arena, shader->common.program_id, "light.quadratic");
 
   // Light
-  std::string vertex_shader_light_path = base_path_assets + "shaders/light.vert";
-  std::string fragment_shader_light_path = base_path_assets + "shaders/light.frag";
-  ReadEntireFile vertex_shader_light_source = read_entire_file(temp, vertex_shader_light_path.c_str());
-  ReadEntireFile fragment_shader_light_source = read_entire_file(temp, fragment_shader_light_path.c_str());
+  StringView vertex_shader_light_path = str_push_concat(temp, base_path_assets, str_view("shaders/light.vert"));
+  StringView fragment_shader_light_path = str_push_concat(temp, base_path_assets, str_view("shaders/light.frag"));
+  ReadEntireFile vertex_shader_light_source = read_entire_file(temp, vertex_shader_light_path.data);
+  ReadEntireFile fragment_shader_light_source = read_entire_file(temp, fragment_shader_light_path.data);
 
   sponza->light_shader = opengl_create_shader(arena, vertex_shader_light_source.content, fragment_shader_light_source.content);
 
@@ -131,12 +140,109 @@ void init()
   glUniform1f(shader->light_linear, 0.09f);
   glUniform1f(shader->light_quadratic, 0.032f);
   glUseProgram(0);
+  scratch_end(scratch);
 }
 
 void deinit()
 {
+  destroy_model(sponza->sponza);
+  destroy_model(sponza->light);
   glDeleteProgram(sponza->shader->common.program_id);
   glDeleteProgram(sponza->light_shader->program_id);
+  glDeleteFramebuffers(1, &sponza->framebuffer);
+  glDeleteRenderbuffers(1, &sponza->rbo);
+  glDeleteTextures(1, &sponza->texture_colorbuffer);
+  // Everything the scene loaded lives in here (shaders, cameras, geometry)
+  arena_release(arena);
+  arena = 0;
+}
+
+static float bytes_to_mb(size_t bytes)
+{
+  return (float)bytes / (float)Megabytes(1);
+}
+
+#define UI_MAX_ARENAS 256
+
+static void ui_render_arenas()
+{
+  if (!ImGui::TreeNodeEx("Arenas", ImGuiTreeNodeFlags_DefaultOpen))
+    return;
+
+  // Workers create and release arenas while we draw, only look at a copy
+  ArenaDebugInfo* arenas = (ArenaDebugInfo*)arena_push_no_zero(frame_arena(), UI_MAX_ARENAS * sizeof(ArenaDebugInfo));
+  uint32_t num_arenas = arena_debug_snapshot(arenas, UI_MAX_ARENAS);
+
+  for (int tag = 0; tag < ArenaTag_Count; tag++)
+  {
+    size_t tag_used = 0;
+    size_t tag_peak = 0;
+    size_t tag_committed = 0;
+    for (uint32_t i = 0; i < num_arenas; i++)
+    {
+      ArenaDebugInfo* it = arenas + i;
+      if (it->tag != tag)
+        continue;
+      tag_used += it->curr_offset;
+      tag_peak += it->peak_offset;
+      tag_committed += it->commit_offset;
+    }
+
+    if (ImGui::TreeNode(arena_tag_name((ArenaTag)tag), "%s: %.2f MB used, %.2f MB peak, %.2f MB committed",
+            arena_tag_name((ArenaTag)tag), bytes_to_mb(tag_used), bytes_to_mb(tag_peak), bytes_to_mb(tag_committed)))
+    {
+      for (uint32_t i = 0; i < num_arenas; i++)
+      {
+        ArenaDebugInfo* it = arenas + i;
+        if (it->tag != tag)
+          continue;
+        if (ImGui::TreeNode(it->id, "%s", it->name))
+        {
+          ImGui::Text("Used: %.3f MB", bytes_to_mb(it->curr_offset));
+          ImGui::Text("Peak: %.3f MB", bytes_to_mb(it->peak_offset));
+          ImGui::Text("Committed: %.3f MB", bytes_to_mb(it->commit_offset));
+          ImGui::Text("Reserved: %.3f MB", bytes_to_mb(it->mem_length));
+          ImGui::Text("Pages: %s", (it->flags & ArenaFlag_HugeTLB) ? "2 MB (hugetlb)" :
+              (it->flags & ArenaFlag_LargePages) ? "2 MB (transparent)" : "default");
+          ImGui::Text("Allocations: %llu", (unsigned long long)it->alloc_count);
+          ImGui::TreePop();
+        }
+      }
+      ImGui::TreePop();
+    }
+  }
+  ImGui::TreePop();
+}
+
+static void ui_render_heap()
+{
+  ImGui::Text("Heap this frame: %llu allocs (%.2f KB), %llu frees (%.2f KB)",
+      (unsigned long long)metrics.frame_allocations, (float)metrics.frame_allocated / 1024.0f,
+      (unsigned long long)metrics.frame_frees, (float)metrics.frame_freed / 1024.0f);
+  ImGui::Text("Heap live: %.2f MB", bytes_to_mb(metrics.current_usage()));
+
+  if (ImGui::TreeNode("Sampled heap allocations"))
+  {
+    AllocSample samples[ALLOC_SAMPLE_COUNT];
+    uint32_t sample_count = alloc_tracker_samples(samples, ALLOC_SAMPLE_COUNT);
+    uint64_t frame_index = alloc_tracker_frame_index();
+    char symbol[256];
+    for (uint32_t i = 0; i < sample_count; i++)
+    {
+      AllocSample* sample = samples + i;
+      if (ImGui::TreeNode(sample, "%zu bytes, %llu frames ago", sample->size,
+              (unsigned long long)(frame_index - sample->frame_index)))
+      {
+        for (uint32_t f = 0; f < sample->frame_count; f++)
+        {
+          alloc_sample_symbol(sample->frames[f], symbol, sizeof(symbol));
+          ImGui::TextUnformatted(symbol);
+        }
+        ImGui::TreePop();
+      }
+    }
+    ImGui::TreePop();
+  }
 }
 
 void ui_render(float delta_time)
@@ -159,15 +265,49 @@ void ui_render(float delta_time)
         1000.0f / (1000.0f * delta_time));
     ImGui::Text("%d vertices, %d indices (%d triangles)", metrics.vertex_count, metrics.indices_count,
         metrics.indices_count / 3);
+    ImGui::Text("Geometry: %.2f MB (%d byte vertices)", bytes_to_mb(metrics.geometry_bytes), (int)sizeof(PackedVertex));
+    ImGui::Text("Vertex cache (FIFO %d): ACMR %.3f -> %.3f, ATVR %.3f -> %.3f", MESH_OPTIMIZE_CACHE_SIZE,
+        metrics.acmr_before, metrics.acmr_after, metrics.atvr_before, metrics.atvr_after);
+    if (sponza->sponza->state == ModelState_Failed)
+      ImGui::Text("Sponza failed to load");
+    else if (sponza->sponza->state != ModelState_Ready)
+      ImGui::Text("Streaming...");
+    ImGui::Text("Triangles drawn: %llu", (unsigned long long)metrics.triangles_drawn);
+    ImGui::SliderFloat("LOD pixel error", &lod_pixel_error, 0.0f, 16.0f);
+    ImGui::Checkbox("Meshlet culling", &meshlet_culling);
+    ImGui::Text("Meshlets: %llu", (unsigned long long)sponza->sponza->meshlets.count);
     ImGui::Separator();
+    ui_render_heap();
+    ui_render_arenas();
 
     ImGui::End();
   }
 }
 
+static void collect_model_metrics(Model* model)
+{
+  for (MeshNode* it = model->meshes; it != 0; it = it->next)
+  {
+    metrics.vertex_count += it->data->num_vertices;
+    metrics.indices_count += it->data->lods[0].num_indices;
+    metrics.geometry_bytes += it->data->num_vertices * sizeof(PackedVertex) +
+      it->data->num_indices * it->data->index_size;
+  }
+  metrics.acmr_before = vertex_cache_acmr(model->vertex_cache_before);
+  metrics.acmr_after = vertex_cache_acmr(model->vertex_cache_after);
+  metrics.atvr_before = vertex_cache_atvr(model->vertex_cache_before);
+  metrics.atvr_after = vertex_cache_atvr(model->vertex_cache_after);
+}
+
 void update_and_render(float delta_time)
 {
   update(app.window, delta_time, camera);
+  stream_models(SPONZA_STREAM_BUDGET);
+  if (!metrics_collected && sponza->sponza->state == ModelState_Ready)
+  {
+    collect_model_metrics(sponza->sponza);
+    metrics_collected = true;
+  }
 
   float light_x = 2.0f * sin(glfwGetTime());
   float light_y = 1.0f;
@@ -182,6 +322,7 @@ void update_and_render(float delta_time)
   light_transform = idk_scale(light_transform, idk_vec3fv(0.2f));
   SponzaShader* shader = sponza->shader;
   OpenGLProgramCommon* light_shader = sponza->light_shader;
+  metrics.triangles_drawn = 0;
 
   {
     // Primary Framebuffer
@@ -191,7 +332,8 @@ void update_and_render(float delta_time)
 
     glUseProgram(shader->common.program_id);
     glUniformMatrix4fv(shader->common.projection, 1, false, camera->projection.elements[0]);
-    glUniformMatrix4fv(shader->common.view, 1, false, view_matrix(camera).elements[0]);
+    idk_mat4 view = view_matrix(camera);
+    glUniformMatrix4fv(shader->common.view, 1, false, view.elements[0]);
     glUniform3fv(shader->common.view_pos, 1, &camera->position[0]);
     glUniform3fv(shader->light_position, 1, &light_pos[0]);
 
@@ -203,12 +345,14 @@ void update_and_render(float delta_time)
     glUniform1f(shader->light_linear, 0.09f);
     glUniform1f(shader->light_quadratic, 0.032f);
 
+    DrawView draw_view = make_draw_view(camera->position, camera->projection, view, HEIGHT, lod_pixel_error);
+    draw_view.cull_meshlets = meshlet_culling;
     glUniformMatrix4fv(shader->common.model, 1, GL_FALSE, model.elements[0]);
-    draw(sponza->sponza,model, (OpenGLProgramCommon*)shader);
+    metrics.triangles_drawn += draw(sponza->sponza, model, (OpenGLProgramCommon*)shader, &draw_view);
 
     glUseProgram(light_shader->program_id);
     glUniformMatrix4fv(light_shader->model, 1, GL_FALSE, light_transform.elements[0]);
-    draw(sponza->light,model, light_shader);
+    metrics.triangles_drawn += draw(sponza->light, light_transform, light_shader, &draw_view);
   }
 
   {
@@ -221,7 +365,8 @@ void update_and_render(float delta_time)
 
     glUseProgram(shader->common.program_id);
     glUniformMatrix4fv(shader->common.projection, 1, false, second_camera->projection.elements[0]);
-    glUniformMatrix4fv(shader->common.view, 1, false, view_matrix(second_camera).elements[0]);
+    idk_mat4 view = view_matrix(second_camera);
+    glUniformMatrix4fv(shader->common.view, 1, false, view.elements[0]);
     glUniform3fv(shader->common.view_pos, 1, &camera->position[0]);
     glUniform3fv(shader->light_position, 1, &light_pos[0]);
 
@@ -233,11 +378,14 @@ void update_and_render(float delta_time)
     glUniform1f(shader->light_linear, 0.09f);
     glUniform1f(shader->light_quadratic, 0.032f);
 
-    draw(sponza->sponza,model, (OpenGLProgramCommon*)shader);
+    DrawView draw_view = make_draw_view(second_camera->position, second_camera->projection, view, HEIGHT,
+        lod_pixel_error);
+    draw_view.cull_meshlets = meshlet_culling;
+    metrics.triangles_drawn += draw(sponza->sponza, model, (OpenGLProgramCommon*)shader, &draw_view);
 
     glUseProgram(light_shader->program_id);
     glUniformMatrix4fv(light_shader->model, 1, GL_FALSE, light_transform.elements[0]);
-    draw(sponza->light,model, light_shader);
+    metrics.triangles_drawn += draw(sponza->light, light_transform, light_shader, &draw_view);
     glBindFramebuffer(GL_FRAMEBUFFER, 0);
     glUseProgram(0);
   }
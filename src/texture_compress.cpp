@@ -0,0 +1,496 @@
+// #include "texture_compress.h"
+#include <math.h>
+#include <stdint.h>
+#include <string.h>
+#if defined(__SSE2__) || defined(_M_X64)
+#include <emmintrin.h>
+#define TEXTURE_SSE2 1
+#else
+#define TEXTURE_SSE2 0
+#endif
+
+// NOTE(ricardo): unity build, the header is documentation only
+#define TEXTURE_MAX_LEVELS 16
+#define TEXTURE_COMPRESS_BAND_ROWS 16
+#define TEXTURE_DOWNSAMPLE_BAND_ROWS 64
+
+enum TextureFormat
+{
+  TextureFormat_BC1, // RGB
+  TextureFormat_BC3, // RGB + separate alpha block
+  TextureFormat_BC4, // R
+  TextureFormat_BC5, // RG
+  TextureFormat_Count
+};
+
+struct TextureLevel
+{
+  uint8_t* data;
+  uint64_t size;
+  int width;
+  int height;
+};
+
+uint32_t texture_block_size(TextureFormat format)
+{
+  return format == TextureFormat_BC1 || format == TextureFormat_BC4 ? 8 : 16;
+}
+
+uint64_t texture_compressed_size(TextureFormat format, int width, int height)
+{
+  uint64_t blocks_x = (uint64_t)(width + 3) / 4;
+  uint64_t blocks_y = (uint64_t)(height + 3) / 4;
+  return blocks_x * blocks_y * texture_block_size(format);
+}
+
+uint32_t texture_level_count(int width, int height)
+{
+  uint32_t count = 1;
+  while (width > 1 || height > 1)
+  {
+    width = width > 1 ? width / 2 : 1;
+    height = height > 1 ? height / 2 : 1;
+    count++;
+  }
+  return count;
+}
+
+// sRGB <-> linear through tables, linear is 16 bit so every sRGB value makes
+// the round trip exactly
+static uint16_t srgb_to_linear_table[256];
+static uint8_t linear_to_srgb_table[65536];
+
+static bool texture_build_srgb_tables()
+{
+  for (int i = 0; i < 256; i++)
+  {
+    float srgb = i / 255.0f;
+    float linear = srgb <= 0.04045f ? srgb / 12.92f : powf((srgb + 0.055f) / 1.055f, 2.4f);
+    srgb_to_linear_table[i] = (uint16_t)(linear * 65535.0f + 0.5f);
+  }
+  for (int i = 0; i < 65536; i++)
+  {
+    float linear = i / 65535.0f;
+    float srgb = linear <= 0.0031308f ? linear * 12.92f : 1.055f * powf(linear, 1.0f / 2.4f) - 0.055f;
+    linear_to_srgb_table[i] = (uint8_t)(srgb * 255.0f + 0.5f);
+  }
+  return true;
+}
+
+static bool srgb_tables_ready = texture_build_srgb_tables();
+
+// Output rows [first_row, first_row + num_rows) of the 2x2 box filter
+static void texture_downsample_rows(const uint8_t* pixels, int width, int height, int channels, bool srgb,
+    uint8_t* result, int first_row, int num_rows)
+{
+  int result_width = width > 1 ? width / 2 : 1;
+  // Alpha (the last channel of 2 and 4 channel images) is never sRGB
+  int color_channels = srgb ? (channels == 2 || channels == 4 ? channels - 1 : channels) : 0;
+  for (int y = first_row; y < first_row + num_rows; y++)
+  {
+    // A 1 pixel wide/high level just samples the same row/column twice
+    const uint8_t* row0 = pixels + (uint64_t)(y * 2 < height ? y * 2 : height - 1) * width * channels;
+    const uint8_t* row1 = pixels + (uint64_t)(y * 2 + 1 < height ? y * 2 + 1 : height - 1) * width * channels;
+    uint8_t* out = result + (uint64_t)y * result_width * channels;
+
+    int x = 0;
+#if TEXTURE_SSE2
+    // NOTE(ricardo): RGBA is the common case, two output pixels per step with
+    // the same rounding as the scalar loop so both paths match exactly
+    if (channels == 4 && color_channels == 0 && width > 1)
+    {
+      __m128i zero = _mm_setzero_si128();
+      __m128i rounding = _mm_set1_epi16(2);
+      for (; x + 2 <= result_width; x += 2)
+      {
+        __m128i top = _mm_loadu_si128((const __m128i*)(row0 + x * 8));
+        __m128i bottom = _mm_loadu_si128((const __m128i*)(row1 + x * 8));
+        __m128i left = _mm_add_epi16(_mm_unpacklo_epi8(top, zero), _mm_unpacklo_epi8(bottom, zero));
+        __m128i right = _mm_add_epi16(_mm_unpackhi_epi8(top, zero), _mm_unpackhi_epi8(bottom, zero));
+        __m128i sum = _mm_add_epi16(_mm_unpacklo_epi64(left, right), _mm_unpackhi_epi64(left, right));
+        sum = _mm_srli_epi16(_mm_add_epi16(sum, rounding), 2);
+        _mm_storel_epi64((__m128i*)(out + x * 4), _mm_packus_epi16(sum, sum));
+      }
+    }
+#endif
+    for (; x < result_width; x++)
+    {
+      int x0 = (x * 2 < width ? x * 2 : width - 1) * channels;
+      int x1 = (x * 2 + 1 < width ? x * 2 + 1 : width - 1) * channels;
+      int c = 0;
+      for (; c < color_channels; c++)
+      {
+        uint32_t sum = srgb_to_linear_table[row0[x0 + c]] + srgb_to_linear_table[row0[x1 + c]] +
+          srgb_to_linear_table[row1[x0 + c]] + srgb_to_linear_table[row1[x1 + c]];
+        out[x * channels + c] = linear_to_srgb_table[(sum + 2) >> 2];
+      }
+      for (; c < channels; c++)
+        out[x * channels + c] = (uint8_t)((row0[x0 + c] + row0[x1 + c] + row1[x0 + c] + row1[x1 + c] + 2) >> 2);
+    }
+  }
+}
+
+void texture_downsample(const uint8_t* pixels, int width, int height, int channels, bool srgb, uint8_t* result)
+{
+  int result_height = height > 1 ? height / 2 : 1;
+  texture_downsample_rows(pixels, width, height, channels, srgb, result, 0, result_height);
+}
+
+struct TextureDownsampleBand
+{
+  const uint8_t* pixels;
+  int width;
+  int height;
+  int channels;
+  bool srgb;
+  int first_row;
+  int num_rows;
+  uint8_t* result;
+};
+
+static void texture_downsample_band_job(void* job_data)
+{
+  TextureDownsampleBand* band = (TextureDownsampleBand*)job_data;
+  texture_downsample_rows(band->pixels, band->width, band->height, band->channels, band->srgb, band->result,
+      band->first_row, band->num_rows);
+}
+
+void texture_generate_mips(Arena* arena, TextureLevel* levels, uint32_t num_levels, int channels, bool srgb)
+{
+  for (uint32_t i = 1; i < num_levels; i++)
+  {
+    TextureLevel* source = levels + i - 1;
+    // Every level needs the one before it, only the rows of a level run in parallel
+    int num_bands = (levels[i].height + TEXTURE_DOWNSAMPLE_BAND_ROWS - 1) / TEXTURE_DOWNSAMPLE_BAND_ROWS;
+    TextureDownsampleBand* bands = (TextureDownsampleBand*)arena_push(arena, num_bands * sizeof(TextureDownsampleBand));
+    JobCounter counter = {};
+    for (int band_index = 0; band_index < num_bands; band_index++)
+    {
+      TextureDownsampleBand* band = bands + band_index;
+      band->pixels = source->data;
+      band->width = source->width;
+      band->height = source->height;
+      band->channels = channels;
+      band->srgb = srgb;
+      band->first_row = band_index * TEXTURE_DOWNSAMPLE_BAND_ROWS;
+      band->num_rows = levels[i].height - band->first_row < TEXTURE_DOWNSAMPLE_BAND_ROWS ?
+        levels[i].height - band->first_row : TEXTURE_DOWNSAMPLE_BAND_ROWS;
+      band->result = levels[i].data;
+      job_push(texture_downsample_band_job, band, &counter);
+    }
+    job_wait(&counter);
+  }
+}
+
+// 4x4 RGBA, missing channels are 0 and alpha is 255
+static void bc_fetch_block(const uint8_t* pixels, int width, int height, int channels, int block_x, int block_y,
+    uint8_t block[16][4])
+{
+  for (int py = 0; py < 4; py++)
+  {
+    int y = block_y * 4 + py < height ? block_y * 4 + py : height - 1;
+    for (int px = 0; px < 4; px++)
+    {
+      int x = block_x * 4 + px < width ? block_x * 4 + px : width - 1;
+      const uint8_t* pixel = pixels + ((uint64_t)y * width + x) * channels;
+      uint8_t* texel = block[py * 4 + px];
+      texel[0] = pixel[0];
+      texel[1] = channels > 1 ? pixel[1] : 0;
+      texel[2] = channels > 2 ? pixel[2] : 0;
+      texel[3] = channels > 3 ? pixel[3] : 255;
+    }
+  }
+}
+
+// BC4
+// Two 8 bit endpoints and a 3 bit index per texel. With a0 > a1 the palette
+// is a0, a1 and six evenly spaced values in between, so the nearest entry is
+// just the rounded position along the ramp.
+static void bc4_encode_block(uint8_t block[16][4], int channel, uint8_t* out)
+{
+  int max_value = 0;
+  int min_value = 255;
+  for (int i = 0; i < 16; i++)
+  {
+    int value = block[i][channel];
+    max_value = value > max_value ? value : max_value;
+    min_value = value < min_value ? value : min_value;
+  }
+
+  out[0] = (uint8_t)max_value;
+  out[1] = (uint8_t)min_value;
+  uint64_t bits = 0;
+  if (max_value > min_value)
+  {
+    int range = max_value - min_value;
+    for (int i = 0; i < 16; i++)
+    {
+      // 0 is a0 and 7 is a1, everything in between maps to indices 2..7
+      int step = ((max_value - block[i][channel]) * 14 + range) / (range * 2);
+      uint64_t index = step == 0 ? 0 : step == 7 ? 1 : step + 1;
+      bits |= index << (3 * i);
+    }
+  }
+  for (int i = 0; i < 6; i++)
+    out[2 + i] = (uint8_t)(bits >> (8 * i));
+}
+
+// BC1
+// Two RGB565 endpoints and a 2 bit index per texel. color0 > color1 selects
+// the 4 color palette (the only one BC3 decodes), equal endpoints just use
+// index 0 everywhere.
+static uint16_t bc1_pack_565(const float color[3])
+{
+  int r = (int)(color[0] * (31.0f / 255.0f) + 0.5f);
+  int g = (int)(color[1] * (63.0f / 255.0f) + 0.5f);
+  int b = (int)(color[2] * (31.0f / 255.0f) + 0.5f);
+  r = r < 0 ? 0 : r > 31 ? 31 : r;
+  g = g < 0 ? 0 : g > 63 ? 63 : g;
+  b = b < 0 ? 0 : b > 31 ? 31 : b;
+  return (uint16_t)((r << 11) | (g << 5) | b);
+}
+
+static void bc1_unpack_565(uint16_t packed, int color[3])
+{
+  int r = (packed >> 11) & 31;
+  int g = (packed >> 5) & 63;
+  int b = packed & 31;
+  color[0] = (r << 3) | (r >> 2);
+  color[1] = (g << 2) | (g >> 4);
+  color[2] = (b << 3) | (b >> 2);
+}
+
+// Orders the endpoints, picks the nearest palette entry per texel and returns
+// the squared error
+static uint32_t bc1_fit_indices(uint8_t block[16][4], uint16_t* color0, uint16_t* color1, uint32_t* bits)
+{
+  if (*color0 < *color1)
+  {
+    uint16_t swap = *color0;
+    *color0 = *color1;
+    *color1 = swap;
+  }
+
+  int palette[4][3];
+  bc1_unpack_565(*color0, palette[0]);
+  bc1_unpack_565(*color1, palette[1]);
+  for (int c = 0; c < 3; c++)
+  {
+    palette[2][c] = (2 * palette[0][c] + palette[1][c]) / 3;
+    palette[3][c] = (palette[0][c] + 2 * palette[1][c]) / 3;
+  }
+  int num_entries = *color0 == *color1 ? 1 : 4;
+
+  *bits = 0;
+  uint32_t error = 0;
+  for (int i = 0; i < 16; i++)
+  {
+    uint32_t best_index = 0;
+    uint32_t best_error = UINT32_MAX;
+    for (int entry = 0; entry < num_entries; entry++)
+    {
+      int dr = block[i][0] - palette[entry][0];
+      int dg = block[i][1] - palette[entry][1];
+      int db = block[i][2] - palette[entry][2];
+      uint32_t entry_error = (uint32_t)(dr * dr + dg * dg + db * db);
+      if (entry_error < best_error)
+      {
+        best_error = entry_error;
+        best_index = entry;
+      }
+    }
+    *bits |= best_index << (2 * i);
+    error += best_error;
+  }
+  return error;
+}
+
+static void bc1_encode_block(uint8_t block[16][4], uint8_t* out)
+{
+  float mean[3] = {};
+  for (int i = 0; i < 16; i++)
+  {
+    for (int c = 0; c < 3; c++)
+      mean[c] += block[i][c] * (1.0f / 16.0f);
+  }
+
+  // Covariance as xx, xy, xz, yy, yz, zz
+  float covariance[6] = {};
+  for (int i = 0; i < 16; i++)
+  {
+    float d[3] = {block[i][0] - mean[0], block[i][1] - mean[1], block[i][2] - mean[2]};
+    covariance[0] += d[0] * d[0];
+    covariance[1] += d[0] * d[1];
+    covariance[2] += d[0] * d[2];
+    covariance[3] += d[1] * d[1];
+    covariance[4] += d[1] * d[2];
+    covariance[5] += d[2] * d[2];
+  }
+
+  // Principal axis by power iteration, a few steps are plenty for 16 points
+  float axis[3] = {1.0f, 1.0f, 1.0f};
+  for (int iteration = 0; iteration < 4; iteration++)
+  {
+    float next[3] = {
+      covariance[0] * axis[0] + covariance[1] * axis[1] + covariance[2] * axis[2],
+      covariance[1] * axis[0] + covariance[3] * axis[1] + covariance[4] * axis[2],
+      covariance[2] * axis[0] + covariance[4] * axis[1] + covariance[5] * axis[2],
+    };
+    float length = sqrtf(next[0] * next[0] + next[1] * next[1] + next[2] * next[2]);
+    if (length < 1e-6f)
+      break;
+    for (int c = 0; c < 3; c++)
+      axis[c] = next[c] / length;
+  }
+
+  float min_t = 0.0f;
+  float max_t = 0.0f;
+  for (int i = 0; i < 16; i++)
+  {
+    float t = (block[i][0] - mean[0]) * axis[0] + (block[i][1] - mean[1]) * axis[1] + (block[i][2] - mean[2]) * axis[2];
+    min_t = t < min_t ? t : min_t;
+    max_t = t > max_t ? t : max_t;
+  }
+  float endpoint0[3];
+  float endpoint1[3];
+  for (int c = 0; c < 3; c++)
+  {
+    endpoint0[c] = mean[c] + axis[c] * max_t;
+    endpoint1[c] = mean[c] + axis[c] * min_t;
+  }
+
+  uint16_t color0 = bc1_pack_565(endpoint0);
+  uint16_t color1 = bc1_pack_565(endpoint1);
+  uint32_t bits;
+  uint32_t error = bc1_fit_indices(block, &color0, &color1, &bits);
+
+  // One least squares pass for the endpoints that best fit those indices
+  if (error > 0 && color0 != color1)
+  {
+    static const float weights[4] = {1.0f, 0.0f, 2.0f / 3.0f, 1.0f / 3.0f};
+    float aa = 0.0f, ab = 0.0f, bb = 0.0f;
+    float ax[3] = {};
+    float bx[3] = {};
+    for (int i = 0; i < 16; i++)
+    {
+      float a = weights[(bits >> (2 * i)) & 3];
+      float b = 1.0f - a;
+      aa += a * a;
+      ab += a * b;
+      bb += b * b;
+      for (int c = 0; c < 3; c++)
+      {
+        ax[c] += a * block[i][c];
+        bx[c] += b * block[i][c];
+      }
+    }
+    float determinant = aa * bb - ab * ab;
+    if (fabsf(determinant) > 1e-6f)
+    {
+      for (int c = 0; c < 3; c++)
+      {
+        endpoint0[c] = (bb * ax[c] - ab * bx[c]) / determinant;
+        endpoint1[c] = (aa * bx[c] - ab * ax[c]) / determinant;
+      }
+      uint16_t refined0 = bc1_pack_565(endpoint0);
+      uint16_t refined1 = bc1_pack_565(endpoint1);
+      uint32_t refined_bits;
+      uint32_t refined_error = bc1_fit_indices(block, &refined0, &refined1, &refined_bits);
+      if (refined_error < error)
+      {
+        color0 = refined0;
+        color1 = refined1;
+        bits = refined_bits;
+      }
+    }
+  }
+
+  out[0] = (uint8_t)color0;
+  out[1] = (uint8_t)(color0 >> 8);
+  out[2] = (uint8_t)color1;
+  out[3] = (uint8_t)(color1 >> 8);
+  out[4] = (uint8_t)bits;
+  out[5] = (uint8_t)(bits >> 8);
+  out[6] = (uint8_t)(bits >> 16);
+  out[7] = (uint8_t)(bits >> 24);
+}
+
+struct TextureCompressBand
+{
+  TextureFormat format;
+  const uint8_t* pixels;
+  int width;
+  int height;
+  int channels;
+  int first_block_row;
+  int num_block_rows;
+  uint8_t* result; // Start of the level
+};
+
+static void texture_compress_band_job(void* job_data)
+{
+  TextureCompressBand* band = (TextureCompressBand*)job_data;
+  int blocks_x = (band->width + 3) / 4;
+  uint32_t block_size = texture_block_size(band->format);
+  uint8_t block[16][4];
+  for (int block_y = band->first_block_row; block_y < band->first_block_row + band->num_block_rows; block_y++)
+  {
+    uint8_t* out = band->result + (uint64_t)block_y * blocks_x * block_size;
+    for (int block_x = 0; block_x < blocks_x; block_x++, out += block_size)
+    {
+      bc_fetch_block(band->pixels, band->width, band->height, band->channels, block_x, block_y, block);
+      switch (band->format)
+      {
+        case TextureFormat_BC1:
+          bc1_encode_block(block, out);
+          break;
+        case TextureFormat_BC3:
+          bc4_encode_block(block, 3, out);
+          bc1_encode_block(block, out + 8);
+          break;
+        case TextureFormat_BC4:
+          bc4_encode_block(block, 0, out);
+          break;
+        case TextureFormat_BC5:
+          bc4_encode_block(block, 0, out);
+          bc4_encode_block(block, 1, out + 8);
+          break;
+        default:
+          break;
+      }
+    }
+  }
+}
+
+void texture_compress_levels(Arena* arena, TextureFormat format, uint8_t** pixels, int channels, TextureLevel* levels,
+    uint32_t num_levels)
+{
+  uint32_t num_bands = 0;
+  for (uint32_t i = 0; i < num_levels; i++)
+  {
+    int blocks_y = (levels[i].height + 3) / 4;
+    num_bands += (blocks_y + TEXTURE_COMPRESS_BAND_ROWS - 1) / TEXTURE_COMPRESS_BAND_ROWS;
+  }
+
+  TextureCompressBand* bands = (TextureCompressBand*)arena_push(arena, num_bands * sizeof(TextureCompressBand));
+  JobCounter counter = {};
+  uint32_t band_index = 0;
+  for (uint32_t i = 0; i < num_levels; i++)
+  {
+    int blocks_y = (levels[i].height + 3) / 4;
+    for (int row = 0; row < blocks_y; row += TEXTURE_COMPRESS_BAND_ROWS)
+    {
+      TextureCompressBand* band = bands + band_index++;
+      band->format = format;
+      band->pixels = pixels[i];
+      band->width = levels[i].width;
+      band->height = levels[i].height;
+      band->channels = channels;
+      band->first_block_row = row;
+      band->num_block_rows = blocks_y - row < TEXTURE_COMPRESS_BAND_ROWS ? blocks_y - row : TEXTURE_COMPRESS_BAND_ROWS;
+      band->result = levels[i].data;
+      job_push(texture_compress_band_job, band, &counter);
+    }
+  }
+  job_wait(&counter);
+}
@@ -0,0 +1,48 @@
+#pragma once
+#include <stdint.h>
+#include "memory.h"
+#include "jobs.h"
+
+// Block Compression
+// CPU encoders for the BCn formats the renderer uploads. Every format works
+// on 4x4 blocks, edge blocks of odd sized levels repeat the last row/column.
+// Endpoints come from the principal axis of the block plus one least squares
+// refinement for color, alpha/red/green blocks use the full 8 value ramp.
+// Levels are split into bands of block rows and encoded as jobs. Mip chains
+// are built here too, on the workers instead of glGenerateMipmap.
+#define TEXTURE_MAX_LEVELS 16
+#define TEXTURE_COMPRESS_BAND_ROWS 16
+#define TEXTURE_DOWNSAMPLE_BAND_ROWS 64
+
+enum TextureFormat
+{
+  TextureFormat_BC1, // RGB
+  TextureFormat_BC3, // RGB + separate alpha block
+  TextureFormat_BC4, // R
+  TextureFormat_BC5, // RG
+  TextureFormat_Count
+};
+
+struct TextureLevel
+{
+  uint8_t* data;
+  uint64_t size;
+  int width;
+  int height;
+};
+
+uint32_t texture_block_size(TextureFormat format);
+uint64_t texture_compressed_size(TextureFormat format, int width, int height);
+// Full chain down to 1x1
+uint32_t texture_level_count(int width, int height);
+// 2x2 box filter into a max(width / 2, 1) by max(height / 2, 1) image. With
+// srgb the color channels are averaged in linear space, alpha never is.
+void texture_downsample(const uint8_t* pixels, int width, int height, int channels, bool srgb, uint8_t* result);
+// levels[0] is the image, every other level needs its size and data set.
+// Each level is split into bands of rows that run as jobs.
+void texture_generate_mips(Arena* arena, TextureLevel* levels, uint32_t num_levels, int channels, bool srgb);
+
+// pixels[i] is level i with channels bytes per pixel, levels[i].data has to fit
+// texture_compressed_size for that level. Returns once every level is encoded.
+void texture_compress_levels(Arena* arena, TextureFormat format, uint8_t** pixels, int channels, TextureLevel* levels,
+    uint32_t num_levels);